@@ -64,6 +64,7 @@
 
 #include "VL53L1X_api.h"
 #include <string.h>
+#include <avr/pgmspace.h>
 
 #if 0
 uint8_t VL51L1X_NVM_CONFIGURATION[] = {
@@ -104,7 +105,8 @@ uint8_t VL51L1X_NVM_CONFIGURATION[] = {
 }
 #endif
 
-const uint8_t VL51L1X_DEFAULT_CONFIGURATION[] = {
+/* kept in flash, SensorInit sends it from there in one burst */
+const uint8_t VL51L1X_DEFAULT_CONFIGURATION[] PROGMEM = {
 0x00, /* 0x2d : set bit 2 and 5 to 1 for fast plus mode (1MHz I2C), else don't touch */
 0x00, /* 0x2e : bit 0 if I2C pulled up at 1.8V, else set bit 0 to 1 (pull up at AVDD) */
 0x00, /* 0x2f : bit 0 if GPIO pulled up at 1.8V, else set bit 0 to 1 (pull up at AVDD) */
@@ -225,11 +227,11 @@ VL53L1X_ERROR VL53L1X_SetI2CAddress(uint16_t dev, uint8_t new_address)
 VL53L1X_ERROR VL53L1X_SensorInit(uint16_t dev)
 {
 	VL53L1X_ERROR status = 0;
-	uint8_t Addr = 0x00, tmp;
+	uint8_t tmp;
 
-	for (Addr = 0x2D; Addr <= 0x87; Addr++){
-		status |= VL53L1_WrByte(dev, Addr, VL51L1X_DEFAULT_CONFIGURATION[Addr - 0x2D]);
-	}
+	/* 0x2D to 0x87 in one transaction, the index auto-increments */
+	status |= VL53L1_WriteMulti_P(dev, 0x2D, VL51L1X_DEFAULT_CONFIGURATION,
+		sizeof(VL51L1X_DEFAULT_CONFIGURATION));
 	status |= VL53L1X_StartRanging(dev);
 	tmp  = 0;
 	while(tmp==0){
@@ -642,6 +644,33 @@ VL53L1X_ERROR VL53L1X_GetResult(uint16_t dev, VL53L1X_Result_t *pResult)
 	return status;
 }
 
+VL53L1X_ERROR VL53L1X_GetResultEx(uint16_t dev, VL53L1X_ResultEx_t *pResult)
+{
+	VL53L1X_ERROR status = 0;
+	uint8_t Temp[17];
+	uint8_t RgSt = 255;
+	uint16_t SpNb, Signal;
+
+	/* 0x89 range status ... 0x99, offsets below are from 0x89 */
+	status |= VL53L1_ReadMulti(dev, VL53L1_RESULT__RANGE_STATUS, Temp, 17);
+	RgSt = Temp[0] & 0x1F;
+	if (RgSt < 24)
+		RgSt = status_rtn[RgSt];
+	pResult->Status = RgSt;
+	pResult->StreamCount = Temp[2];
+	SpNb = Temp[3] << 8 | Temp[4];                     /* 0x8C */
+	pResult->NumSPADs = SpNb >> 8;
+	pResult->Ambient = (Temp[7] << 8 | Temp[8]) * 8;  /* 0x90 */
+	pResult->Sigma = (Temp[9] << 8 | Temp[10]) >> 2;  /* 0x92, 14.2 fixed point */
+	pResult->Distance = Temp[13] << 8 | Temp[14];      /* 0x96 */
+	Signal = Temp[15] << 8 | Temp[16];                 /* 0x98 */
+	pResult->SignalRate = Signal * 8;
+	/* as GetSignalPerSpad, integer only */
+	pResult->SigPerSPAD = SpNb ? (uint16_t)(200UL * Signal / SpNb) : 0;
+
+	return status;
+}
+
 VL53L1X_ERROR VL53L1X_SetOffset(uint16_t dev, int16_t OffsetValue)
 {
 	VL53L1X_ERROR status = 0;
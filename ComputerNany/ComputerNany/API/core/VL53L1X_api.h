@@ -112,6 +112,7 @@ typedef int8_t VL53L1X_ERROR;
 #define VL53L1_RESULT__RANGE_STATUS							0x0089
 #define VL53L1_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0		0x008C
 #define RESULT__AMBIENT_COUNT_RATE_MCPS_SD					0x0090
+#define VL53L1_RESULT__SIGMA_SD0							0x0092
 #define VL53L1_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0				0x0096
 #define VL53L1_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0 	0x0098
 #define VL53L1_RESULT__OSC_CALIBRATE_VAL					0x00DE
@@ -144,6 +145,21 @@ typedef struct {
 	uint16_t NumSPADs;	/*!< ResultNumSPADs */
 } VL53L1X_Result_t;
 
+/**
+ *  @brief defines extended reading results type, with the confidence data
+ *  that comes in the same result block read
+ */
+typedef struct {
+	uint8_t Status;		/*!< ResultStatus, as GetRangeStatus */
+	uint8_t StreamCount;/*!< ResultStreamCount, steps on every new sample */
+	uint16_t Distance;	/*!< ResultDistance (mm) */
+	uint16_t Ambient;	/*!< ResultAmbient (kcps), as GetAmbientRate */
+	uint16_t SignalRate;/*!< ResultSignalRate (kcps), as GetSignalRate */
+	uint16_t SigPerSPAD;/*!< ResultSignalPerSPAD (kcps/SPAD), as GetSignalPerSpad */
+	uint16_t NumSPADs;	/*!< ResultNumSPADs, as GetSpadNb */
+	uint16_t Sigma;		/*!< ResultSigma, estimated range deviation (mm) */
+} VL53L1X_ResultEx_t;
+
 /**
  * @brief This function returns the SW driver version
  */
@@ -285,6 +301,12 @@ VL53L1X_ERROR VL53L1X_GetRangeStatus(uint16_t dev, uint8_t *rangeStatus);
  */
 VL53L1X_ERROR VL53L1X_GetResult(uint16_t dev, VL53L1X_Result_t *pResult);
 
+/**
+ * @brief This function returns the range status, distance and confidence data
+ * (sigma, signal and ambient rates) from the same single read access as GetResult
+ */
+VL53L1X_ERROR VL53L1X_GetResultEx(uint16_t dev, VL53L1X_ResultEx_t *pResult);
+
 /**
  * @brief This function programs the offset correction in mm
  * @param OffsetValue:the offset correction value to program in mm
@@ -36,229 +36,175 @@
 #include "vl53l1_platform.h"
 #include <string.h>
 #include <time.h>
-#include <math.h>
+#include <avr/pgmspace.h>
 #include "I2C.h"
 
-int8_t VL53L1_WriteMulti( uint16_t dev, uint16_t index, uint8_t *pdata, uint32_t count) {
-	//	send device address, intent to write
-	if (I2C_Start( 0x29, I2C_WRITE))
-		return -1;
-
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
-
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_NOSTOP))
-		return -2;
-
-	for (int i = 0; i < count -1; i++) {
-		//	write the command
-		if (I2C_Write8( pdata[i], I2C_NOSTOP))
-			return -3;
-	}
-
-	//	write the command
-	if (I2C_Write8( pdata[count - 1], I2C_STOP))
-		return -4;
+//	7-bit bus address of the sensor (dev is not used on this platform)
+#define VL53L1_I2C_ADDR 0x29
+
+//	write-through shadow of the static configuration block (the one
+//	 SensorInit loads), so configuration the API reads back after setting
+//	 it, e.g. the interrupt polarity on every data ready poll, comes from RAM
+//	GPIO__TIO_HV_STATUS, SYSTEM__INTERRUPT_CLEAR and SYSTEM__MODE_START sit
+//	 in the block but are status or strobes, so like the results and
+//	 everything else outside the block they always go to the bus
+//	a byte becomes valid when it is written or read over the bus, a failed
+//	 write drops it again, and a soft reset (0x0000) drops them all
+#define VL53L1_SHADOW_FIRST 0x2D
+#define VL53L1_SHADOW_LAST 0x87
+#define VL53L1_SHADOW_SIZE (VL53L1_SHADOW_LAST - VL53L1_SHADOW_FIRST + 1)
+
+static uint8_t _Shadow[VL53L1_SHADOW_SIZE];
+static uint8_t _ShadowValid[(VL53L1_SHADOW_SIZE + 7) / 8];
+
+static uint8_t VL53L1_Shadowed(uint16_t index) {
+	return index >= VL53L1_SHADOW_FIRST && index <= VL53L1_SHADOW_LAST &&
+		index != 0x31 && index != 0x86 && index != 0x87;
+}
 
-	return 0;
+//	record bytes that went to or came from the device, pdata may be in flash
+static void VL53L1_ShadowStore(uint16_t index, const uint8_t *pdata, uint32_t count, uint8_t bFlash) {
+	uint16_t i;
 
-}
+	for (; count; --count, ++index, ++pdata) {
+		if (!VL53L1_Shadowed(index))
+			continue;
 
-int8_t VL53L1_ReadMulti(uint16_t dev, uint16_t index, uint8_t *pdata, uint32_t count){
-	// start transaction with device address, intent to write
-	if (I2C_Start(0x29, I2C_WRITE))
-		return -1;
-
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
-
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_STOP))
-		return -2;
-
-	// start transaction with device address, intent to read
-	if (I2C_Start(0x29, I2C_READ))
-		return -3;
-
-	// read the data bytes
-	for (uint32_t i = 0; i < count; i++) {
-		if (i == (count - 1)) {
-			if (I2C_Read8(&pdata[i], I2C_ACK, I2C_STOP)){
-				return -4;
-			}
-		}
-		else {
-			if (I2C_Read8(&pdata[i], I2C_NACK, I2C_NOSTOP))
-				return -5;
-		}
+		i = index - VL53L1_SHADOW_FIRST;
+		_Shadow[i] = bFlash ? pgm_read_byte(pdata) : *pdata;
+		_ShadowValid[i >> 3] |= 1 << (i & 7);
 	}
-
-	return 0;
 }
 
-int8_t VL53L1_WrByte(uint16_t dev, uint16_t index, uint8_t data) {
-	//	send device address, intent to write
-	if (I2C_Start( 0x29, I2C_WRITE))
-		return -1;
+//	forget bytes whose device value is no longer known
+static void VL53L1_ShadowDrop(uint16_t index, uint32_t count) {
+	uint16_t i;
 
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
+	for (; count; --count, ++index) {
+		if (!VL53L1_Shadowed(index))
+			continue;
 
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_NOSTOP))
-		return -2;
+		i = index - VL53L1_SHADOW_FIRST;
+		_ShadowValid[i >> 3] &= ~(1 << (i & 7));
+	}
+}
 
-	//	write the command
-	if (I2C_Write8( data, I2C_NOSTOP))
-		return -3;
+//	serve a read from RAM, all or nothing (a partly shadowed read costs one
+//	 transaction either way), returns 1 on a hit
+static uint8_t VL53L1_ShadowLoad(uint16_t index, uint8_t *pdata, uint32_t count) {
+	uint16_t i;
+	uint32_t n;
 
-	return 0;
-}
+	for (n = 0; n < count; ++n) {
+		if (!VL53L1_Shadowed(index + n))
+			return 0;
 
-int8_t VL53L1_WrWord(uint16_t dev, uint16_t index, uint16_t data) {
-	// send device address, intent to write
-	if (I2C_Start(0x29, I2C_WRITE))
-		return -1;
-	
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
-
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_NOSTOP))
-		return -2;
-	
-	// write the command
-	if (I2C_Write8((unsigned char)(data >> 8), I2C_NOSTOP))
-		return -3;
-
-	// write the command
-	if (I2C_Write8((unsigned char)data, I2C_STOP))
-		return -4;
+		i = index + n - VL53L1_SHADOW_FIRST;
+		if (!(_ShadowValid[i >> 3] & (1 << (i & 7))))
+			return 0;
+	}
 
-	return 0;
+	memcpy(pdata, &_Shadow[index - VL53L1_SHADOW_FIRST], count);
+	return 1;
 }
 
-int8_t VL53L1_WrDWord(uint16_t dev, uint16_t index, uint32_t data) {
-	// send device address, intent to write
-	if (I2C_Start(0x29, I2C_WRITE))
-		return -1;
+//	index then data in one transaction, shadow kept in step
+static int8_t VL53L1_Write(uint16_t index, const uint8_t *pdata, uint32_t count, uint8_t bFlash) {
+	int8_t iErr;
 
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
+	iErr = bFlash ? I2C_WriteRegs16_P(VL53L1_I2C_ADDR, index, pdata, count)
+		: I2C_WriteRegs16(VL53L1_I2C_ADDR, index, pdata, count);
 
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_NOSTOP))
-		return -2;
+	if (index == 0x0000)
+		memset(_ShadowValid, 0, sizeof(_ShadowValid));
 
-	// write the command
-	if (I2C_Write8((unsigned char)(data >> 24), I2C_NOSTOP))
-		return -3;
+	if (iErr)
+		VL53L1_ShadowDrop(index, count);
+	else
+		VL53L1_ShadowStore(index, pdata, count, bFlash);
+
+	return iErr;
+}
 
-	// write the command
-	if (I2C_Write8((unsigned char)(data >> 16), I2C_NOSTOP))
-		return -4;
+//	write the index, repeated START, then read the data bytes, unless the
+//	 shadow has them all
+static int8_t VL53L1_Read(uint16_t index, uint8_t *pdata, uint32_t count) {
+	int8_t iErr;
 
-	// write the command
-	if (I2C_Write8((unsigned char)(data >> 8), I2C_NOSTOP))
-		return -5;
+	if (VL53L1_ShadowLoad(index, pdata, count))
+		return 0;
 
-	// write the command
-	if (I2C_Write8(data, I2C_STOP))
-		return -6;
+	if ((iErr = I2C_ReadRegs16(VL53L1_I2C_ADDR, index, pdata, count)))
+		return iErr;
 
+	VL53L1_ShadowStore(index, pdata, count, 0);
 	return 0;
 }
 
-int8_t VL53L1_RdByte(uint16_t dev, uint16_t index, uint8_t *data) {
-	// start transaction with device adress, intent to write
-	if (I2C_Start(0x29, I2C_WRITE))
-		return -1;
+int8_t VL53L1_WriteMulti( uint16_t dev, uint16_t index, uint8_t *pdata, uint32_t count) {
+	return VL53L1_Write(index, pdata, count, 0);
+}
 
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
+int8_t VL53L1_WriteMulti_P( uint16_t dev, uint16_t index, const uint8_t *pdata, uint32_t count) {
+	//	as WriteMulti, data bytes fetched from flash as they go out
+	return VL53L1_Write(index, pdata, count, 1);
+}
 
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_STOP))
-		return -3;
+int8_t VL53L1_ReadMulti(uint16_t dev, uint16_t index, uint8_t *pdata, uint32_t count){
+	return VL53L1_Read(index, pdata, count);
+}
 
-	// start transaction with device adress, intent to read
-	if (I2C_Start(0x29, I2C_READ))
-		return -4;
+int8_t VL53L1_WrByte(uint16_t dev, uint16_t index, uint8_t data) {
+	return VL53L1_Write(index, &data, 1, 0);
+}
 
-	// stop the transaction
-	if (I2C_Read8(data, I2C_NACK, I2C_STOP))
-		return -5;
+int8_t VL53L1_WrWord(uint16_t dev, uint16_t index, uint16_t data) {
+	//	device registers are big endian
+	uint8_t ucData[2];
 
-	return 0;
+	ucData[0] = (uint8_t)(data >> 8);
+	ucData[1] = (uint8_t)data;
+
+	return VL53L1_Write(index, ucData, 2, 0);
 }
 
-int8_t VL53L1_RdWord(uint16_t dev, uint16_t index, uint16_t *data) {
-	unsigned char ucDataH, ucDataL;
-	// start transaction with device address, intent to write
-	if (I2C_Start(0X29, I2C_WRITE))
-		return -1;
+int8_t VL53L1_WrDWord(uint16_t dev, uint16_t index, uint32_t data) {
+	//	device registers are big endian
+	uint8_t ucData[4];
 
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
+	ucData[0] = (uint8_t)(data >> 24);
+	ucData[1] = (uint8_t)(data >> 16);
+	ucData[2] = (uint8_t)(data >> 8);
+	ucData[3] = (uint8_t)data;
 
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_STOP))
-		return -2;
+	return VL53L1_Write(index, ucData, 4, 0);
+}
 
-	// start transaction with device address, intent to read
-	if (I2C_Start(0x29, I2C_READ))
-		return -3;
+int8_t VL53L1_RdByte(uint16_t dev, uint16_t index, uint8_t *data) {
+	return VL53L1_Read(index, data, 1);
+}
 
-	// read the low byte
-	if (I2C_Read8(&ucDataL, I2C_ACK, I2C_NOSTOP))
-		return -4;
+int8_t VL53L1_RdWord(uint16_t dev, uint16_t index, uint16_t *data) {
+	uint8_t ucData[2];
+	int8_t iErr;
 
-	// read the high byte
-	if (I2C_Read8(&ucDataH, I2C_NACK, I2C_STOP))
-		return -5;
+	if ((iErr = VL53L1_Read(index, ucData, 2)))
+		return iErr;
 
-	*data = (ucDataL << 8) | ucDataH;
+	//	device registers are big endian
+	*data = ((uint16_t)ucData[0] << 8) | ucData[1];
 
-	return 0;	
+	return 0;
 }
 
 int8_t VL53L1_RdDWord(uint16_t dev, uint16_t index, uint32_t *data) {
-	unsigned char ucData[4];
-	// start transaction with device address, intent to write
-	if (I2C_Start(0X29, I2C_WRITE))
-		return -1;
-
-	//	write the first byte of the index
-	if (I2C_Write8( (unsigned char)(index >> 8), I2C_NOSTOP))
-		return -2;
-
-	//	write the rest of the index
-	if (I2C_Write8( (unsigned char)index, I2C_STOP))
-		return -2;
-
-	// start transaction with device address, intent to read
-	if (I2C_Start(0x29, I2C_READ))
-		return -3;
-
-	// read the data bytes
-	if (I2C_Read8(&ucData[0], I2C_ACK, I2C_NOSTOP))
-		return -4;
-	if (I2C_Read8(&ucData[1], I2C_ACK, I2C_NOSTOP))
-		return -5;
-	if (I2C_Read8(&ucData[2], I2C_ACK, I2C_NOSTOP))
-		return -6;
-	if (I2C_Read8(&ucData[3], I2C_NACK, I2C_STOP))
-		return -7;
-
-	*data = (ucData[0] << 24) | (ucData[1] << 16) | (ucData[2] << 8) | ucData[3];
+	uint8_t ucData[4];
+	int8_t iErr;
+
+	if ((iErr = VL53L1_Read(index, ucData, 4)))
+		return iErr;
+
+	*data = ((uint32_t)ucData[0] << 24) | ((uint32_t)ucData[1] << 16) | ((uint32_t)ucData[2] << 8) | ucData[3];
 
 	return 0;
 }
@@ -31,6 +31,15 @@ int8_t VL53L1_WriteMulti(
 		uint16_t      index,
 		uint8_t      *pdata,
 		uint32_t      count);
+/** @brief VL53L1_WriteMulti_P() definition.
+ * Same as VL53L1_WriteMulti, but the data is read straight from flash
+ * (PROGMEM), so a constant block needs no RAM copy.
+ */
+int8_t VL53L1_WriteMulti_P(
+		uint16_t 			dev,
+		uint16_t      index,
+		const uint8_t *pdata,
+		uint32_t      count);
 /** @brief VL53L1_ReadMulti() definition.
  * This function reads multiple bytes of data from a specific index in the VL53L1 sensor. 
  * The function takes the device address, 
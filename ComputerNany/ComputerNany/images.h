@@ -0,0 +1,59 @@
+/*
+ * images.h
+ *
+ * Bitmaps for SSD1306_BlitRLE, generated from the PBM files in images,
+ *  from this directory:
+ *  python ../../tools/rle_encode.py images/icon_present.pbm
+ *      images/icon_coffee.pbm images/icon_away.pbm images/splash.pbm
+ * Edit the PBM files and regenerate rather than editing the arrays.
+ */
+
+#ifndef IMAGES_H
+#define IMAGES_H
+
+#include <avr/pgmspace.h>
+
+// icon_present.pbm, 16 x 16, RLE, 23 bytes (32 raw)
+static const unsigned char icon_present [23] PROGMEM =
+{
+  0x10, 0x02, 0x83, 0x00, 0x01, 0x3C, 0x7E, 0x83, 0xFF, 0x01, 0x7E, 0x3C, 0x84, 0x00, 0x01, 0x78,
+  0x7C, 0x89, 0x7E, 0x02, 0x7C, 0x78, 0x00
+};
+
+// icon_coffee.pbm, 16 x 16, RLE, 31 bytes (32 raw)
+static const unsigned char icon_coffee [31] PROGMEM =
+{
+  0x10, 0x02, 0x12, 0x00, 0xE0, 0xE0, 0xEA, 0xE5, 0xE0, 0xEA, 0xE5, 0xE0, 0xEA, 0xE5, 0xE0, 0x00,
+  0x40, 0xC0, 0x00, 0x40, 0x43, 0x4F, 0x86, 0x5F, 0x05, 0x4F, 0x43, 0x40, 0x42, 0x03, 0x00
+};
+
+// icon_away.pbm, 16 x 16, stored, 34 bytes (32 raw)
+static const unsigned char icon_away [34] PROGMEM =
+{
+  0x10, 0x82, 0x00, 0x03, 0x0F, 0x13, 0x23, 0x53, 0xB3, 0x73, 0x73, 0xB3, 0x53, 0x23, 0x13, 0x0F,
+  0x03, 0x00, 0x00, 0xC0, 0xF0, 0xC8, 0xE4, 0xF2, 0xF9, 0xFC, 0xFC, 0xF9, 0xF2, 0xE4, 0xC8, 0xF0,
+  0xC0, 0x00
+};
+
+// splash.pbm, 128 x 32, RLE, 246 bytes (512 raw)
+static const unsigned char splash [246] PROGMEM =
+{
+  0x80, 0x04, 0x90, 0x00, 0x01, 0xF8, 0xF8, 0x85, 0x06, 0x05, 0x18, 0x18, 0x00, 0x00, 0x80, 0x80,
+  0x85, 0x60, 0x11, 0x80, 0x80, 0x00, 0x00, 0xE0, 0xE0, 0x60, 0x60, 0x80, 0x80, 0x60, 0x60, 0xE0,
+  0xE0, 0x00, 0x00, 0xE0, 0xE0, 0x85, 0x60, 0x05, 0x80, 0x80, 0x00, 0x00, 0xE0, 0xE0, 0x85, 0x00,
+  0x03, 0xE0, 0xE0, 0x00, 0x00, 0x83, 0x80, 0x01, 0xF8, 0xF8, 0x83, 0x80, 0x03, 0x00, 0x00, 0x80,
+  0x80, 0x85, 0x60, 0x05, 0x80, 0x80, 0x00, 0x00, 0xE0, 0xE0, 0x85, 0x60, 0x01, 0x80, 0x80, 0xA1,
+  0x00, 0x01, 0x1F, 0x1F, 0x85, 0x60, 0x05, 0x18, 0x18, 0x00, 0x00, 0x1F, 0x1F, 0x85, 0x60, 0x11,
+  0x1F, 0x1F, 0x00, 0x00, 0x7F, 0x7F, 0x00, 0x00, 0x07, 0x07, 0x00, 0x00, 0x7F, 0x7F, 0x00, 0x00,
+  0x7F, 0x7F, 0x85, 0x06, 0x05, 0x01, 0x01, 0x00, 0x00, 0x1F, 0x1F, 0x85, 0x60, 0x03, 0x1F, 0x1F,
+  0x00, 0x00, 0x83, 0x01, 0x09, 0x7F, 0x7F, 0x61, 0x61, 0x01, 0x01, 0x00, 0x00, 0x1F, 0x1F, 0x85,
+  0x66, 0x05, 0x19, 0x19, 0x00, 0x00, 0x7F, 0x7F, 0x85, 0x00, 0x01, 0x01, 0x01, 0xB9, 0x00, 0x0B,
+  0xFE, 0xFE, 0x60, 0x60, 0x80, 0x80, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0x87, 0x60, 0x05, 0x80,
+  0x80, 0x00, 0x00, 0xE0, 0xE0, 0x85, 0x60, 0x05, 0x80, 0x80, 0x00, 0x00, 0x7E, 0x7E, 0x85, 0x80,
+  0x01, 0x7E, 0x7E, 0xAC, 0x00, 0x9F, 0x01, 0x84, 0x00, 0x0D, 0x7F, 0x7F, 0x00, 0x00, 0x01, 0x01,
+  0x06, 0x06, 0x7F, 0x7F, 0x00, 0x00, 0x18, 0x18, 0x85, 0x66, 0x05, 0x7F, 0x7F, 0x00, 0x00, 0x7F,
+  0x7F, 0x85, 0x00, 0x0B, 0x7F, 0x7F, 0x00, 0x00, 0x18, 0x18, 0x61, 0x61, 0x1F, 0x1F, 0x01, 0x01,
+  0x86, 0x00, 0x9F, 0x01, 0x83, 0x00
+};
+
+#endif
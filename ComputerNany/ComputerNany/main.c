@@ -34,10 +34,50 @@
 #include "I2C.h"
 #include "SSD1306.h"
 #include "VL53L1X_api.h"
+#include "images.h"
+#if defined(I2C_STATS_DUMP) || defined(OLED_BENCHMARK) || defined(GFX_BENCHMARK)
+#include "sci.h"
+#endif
 
 //  Switch connected to PD2
 #define SWITCH PD2
 
+//  VL53L1X 7-bit I2C address
+#define TOF_ADDRESS 0x29
+
+//  Comment in when the VL53L1X GPIO1 (data ready, open drain) is wired to
+//  PD3/INT1: the MCU sleeps until a sample exists instead of polling the
+//  sensor over I2C for the whole timing budget
+//#define TOF_GPIO1_IRQ
+//  Timer 1 ticks (100 ms) without a GPIO1 edge before polling the sensor
+#define TOF_IRQ_TIMEOUT_TICKS 12
+
+//  Sensor runs free, one sample per period (timing budget and
+//  inter-measurement period, short distance mode allows down to 20 ms)
+#define TOF_PERIOD_MS 100
+
+//  Timer 1 ticks (100 ms) between display updates, LED blink, colour
+//  cycling and switch polls, once a second like the old blocking loop
+#define UI_TICKS 10
+
+//  Comment in to print OLED full-frame render rates over serial at startup
+//#define OLED_BENCHMARK
+#define OLED_BENCHMARK_FRAMES 32
+
+//  Comment in to print CPU cycles per circle and line over serial at startup
+//  (back-buffer only, nothing is rendered)
+//#define GFX_BENCHMARK
+#define GFX_BENCHMARK_SHAPES 32
+
+//  Session length before a break, matches the minutes rollover in the
+//  timer ISR
+#define BREAK_SECONDS 3600U
+
+//  Comment in to run the ToF sensor at 1 MHz (Fast-mode Plus)
+//  Needs pull-ups strong enough for the faster edges, and is past the
+//  400 kHz the ATmega328P TWI is rated for, so bench check SCL first
+//#define TOF_FAST_MODE_PLUS
+
 /* Define constants */
 //  Color constants
 typedef enum
@@ -78,6 +118,17 @@ typedef enum
 VL53L1X_ERROR tof_status;
 uint8_t state = 0;
 uint16_t tof_distance;
+//  Latest sample with its range status and confidence data
+VL53L1X_ResultEx_t tof_result;
+#ifdef TOF_GPIO1_IRQ
+//  Set by the GPIO1 interrupt when a sample is ready
+volatile uint8_t tof_ready = 0;
+//  timer_ticks at the last sample, to notice GPIO1 going quiet
+uint8_t tof_sample_ticks = 0;
+#endif
+
+//  Timer 1 ticks (100 ms), paces the main loop
+volatile uint8_t timer_ticks = 0;
 
 //  Time variables
 uint32_t time_to_sleep = 0;
@@ -104,21 +155,27 @@ uint8_t r = 0;
 uint8_t s = 0;
 uint8_t t = 0;
 
-//  String variables
-char str[20];
-char str2[20];
-char str3[20];
-char str4[20];
+#ifdef I2C_STATS_DUMP
+//  Main loop passes between I2C statistics dumps (~10 s)
+#define STATS_LOOPS 20     //  display updates
+uint8_t stats_loops = 0;
+#endif
 
 
 /* Function prototypes */
 void tof_init(void);
 void switch_init(void);
 void start_Animation(void);
-void tof_check_distance(void);
+uint8_t tof_service(void);
 void go_to_sleep(void);
 void change_color(void);
 void set_color(color_enum_t color);
+#ifdef OLED_BENCHMARK
+void oled_benchmark(void);
+#endif
+#ifdef GFX_BENCHMARK
+void gfx_benchmark(void);
+#endif
 
 
 
@@ -127,7 +184,10 @@ void set_color(color_enum_t color);
 int main(void)
 {
     /* Initialize I2C */
+    //  Unknown devices stay at 100 kHz, the OLED and ToF sensor run at 400 kHz
     I2C_Init(F_CPU, I2CBus100);
+    I2C_SetDeviceRate(_SSD1306_ADDRESS, I2CBus400);
+    I2C_SetDeviceRate(TOF_ADDRESS, I2CBus400);
 
     /* Initialize NeoPixel */
     neopixel_init();
@@ -139,7 +199,6 @@ int main(void)
     SSD1306_DisplayOn();
     //  Clear display
     SSD1306_Clear();
-    SSD1306_Render();
 
     /* Initialize Time of Flight sensor */
     tof_init();
@@ -153,6 +212,25 @@ int main(void)
     /* Enable sleep mode for power saving */
     sleep_enable();
 
+#if defined(I2C_STATS_DUMP) || defined(OLED_BENCHMARK) || defined(GFX_BENCHMARK)
+    SCI0_Init(F_CPU, 9600, 0);
+#endif
+
+#ifdef OLED_BENCHMARK
+    /* Render rate, needs Timer 1 running */
+    oled_benchmark();
+#endif
+
+#ifdef GFX_BENCHMARK
+    /* Drawing cost, needs Timer 1 running */
+    gfx_benchmark();
+#endif
+
+#ifdef I2C_STATS_DUMP
+    /* I2C statistics over serial, busy time counts from here (Timer 1) */
+    I2C_ResetStats();
+#endif
+
 
     /* Initialize switch */
     switch_init();
@@ -169,14 +247,43 @@ int main(void)
     sei();
 
     /* Main loop */
+    uint8_t last_tick = timer_ticks;
+    uint8_t ui_ticks = 0;
     while (1) 
     {
-        //  Call the interrupt
-        sleep_mode();
-        /* Check distance with Time of Flight sensor */
-        tof_check_distance();
+        /* Sleep until the next timer tick or ToF sample, other wakes (TWI
+           during a background render) go straight back to sleep */
+        cli();
+#ifdef TOF_GPIO1_IRQ
+        while (timer_ticks == last_tick && !tof_ready)
+#else
+        while (timer_ticks == last_tick)
+#endif
+        {
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            cli();
+        }
+        uint8_t now = timer_ticks;
+        sei();
+
+        /* Latest distance from the Time of Flight sensor */
+        tof_service();
 
-        SSD1306_Clear();
+        /* Display, LEDs and switch every UI_TICKS, the newest sample is
+           used whenever they run */
+        ui_ticks += (uint8_t)(now - last_tick);
+        last_tick = now;
+        if (ui_ticks < UI_TICKS)
+        {
+            continue;
+        }
+        ui_ticks = 0;
+
+        /* Draw this pass into a fresh frame, sent once at the end */
+        SSD1306_BeginFrame();
+        uint8_t banner = 0;
 
         /* Check switch status */
         if((PIND & (1 << SWITCH)))
@@ -196,17 +303,25 @@ int main(void)
         }
 
         /* Check if there is someone in front of the computer */
-        if(tof_distance < 500)
+        /* Only a valid range counts, with no target in view the sensor
+           reports a signal failure and a meaningless distance */
+        if(tof_result.Status == 0 && tof_distance < 500)
         {
             user_is_here = 1; 
             
             if (time_to_blink)
             {
-                SSD1306_StringXY(0, 0, "Take a break!");
-                SSD1306_StringXY(1, 1, "Take a break!");
-                SSD1306_StringXY(2, 2, "Take a break!");
-                SSD1306_StringXY(3, 3, "Take a break!");
-                SSD1306_Render();
+                /* Ticker: sent once, then the panel scrolls it by itself */
+                banner = 1;
+                SSD1306_StringXY_P(0, 0, PSTR("Take a break!"));
+                SSD1306_StringXY_P(1, 1, PSTR("Take a break!"));
+                SSD1306_StringXY_P(2, 2, PSTR("Take a break!"));
+                SSD1306_StringXY_P(3, 3, PSTR("Take a break!"));
+                SSD1306_BlitRLE(108, 1, (PGM_P)icon_coffee);
+                if (!SSD1306_Scrolling())
+                {
+                    SSD1306_ScrollH(1, 0, 3, SSD1306_SCROLL_4);
+                }
                 if(time_to_change_color)
                 {
                     time_to_change_color = 0;
@@ -225,12 +340,21 @@ int main(void)
                 /* Turn on NeoPixel */
                 set_color(current_color);
                 neopixel_update();
-                /* Display time on OLED display */
-                sprintf(str, "Time: %u:%u", minutes, seconds);
-                sprintf(str2, "Distance: %u.%u cm", tof_distance/10, tof_distance%10);
-                SSD1306_StringXY(0, 0, str);
-                SSD1306_StringXY(0, 3, str2);
-                SSD1306_Render();
+                /* Display time on OLED display, large MM:SS on pages 0-2 */
+                uint8_t clock_minutes = minutes;
+                uint8_t clock_seconds = seconds;
+                char clock[6] = {
+                    '0' + clock_minutes / 10, '0' + clock_minutes % 10, ':',
+                    '0' + clock_seconds / 10, '0' + clock_seconds % 10, 0 };
+                SSD1306_BigStringXY(0, 0, clock);
+                SSD1306_BlitRLE(76, 0, (PGM_P)icon_present);
+                /* Distance is in mm, shown in cm with one decimal */
+                SSD1306_StringXY_P(0, 3, PSTR("Distance: "));
+                uint8_t col = SSD1306_FixedXY(10, 3, tof_distance, 1, 0);
+                SSD1306_StringXY_P(col, 3, PSTR(" cm"));
+                /* Time left until the break, drains as the session runs */
+                SSD1306_ProgressBar(96, 2, 32, 12,
+                    BREAK_SECONDS - (clock_minutes * 60U + clock_seconds), BREAK_SECONDS);
             }
             
         }
@@ -240,17 +364,33 @@ int main(void)
             if (waiting_user)
             {
                 /* Display Leave seconds on OLED display */
-                sprintf(str, "Waiting: %u", ( 10 - leave_seconds));
-                SSD1306_StringXY(0, 0, str);
-                SSD1306_Render();
+                SSD1306_StringXY_P(0, 0, PSTR("Waiting: "));
+                SSD1306_DecimalXY(9, 0, 10 - leave_seconds, 0);
+                SSD1306_BlitRLE(112, 1, (PGM_P)icon_away);
             }
             /* Turn off NeoPixel */
             neopixel_turn_off_all();
             neopixel_update();
         }
 
-        /* Sleep for 500ms*/
-        _delay_ms(500);
+        /* Banner gone, the panel gets the normal frame back */
+        if (!banner && SSD1306_Scrolling())
+        {
+            SSD1306_ScrollStop();
+        }
+
+        /* One display update per pass, sent in the background so the
+           sleep and the next ToF read overlap the OLED transfer */
+        SSD1306_RenderAsync();
+
+#ifdef I2C_STATS_DUMP
+        /* Report which device the bus time went to */
+        if (++stats_loops >= STATS_LOOPS)
+        {
+            stats_loops = 0;
+            I2C_StatsDump();
+        }
+#endif
 
     }
 }
@@ -267,9 +407,26 @@ void tof_init(void)
     }
     //  Initialize the VL53L1X sensor
     tof_status = VL53L1X_SensorInit(0);
+#ifdef TOF_FAST_MODE_PLUS
+    //  Set bits 2 and 5 of 0x2D for fast plus mode (SensorInit wrote 0x00)
+    tof_status = VL53L1_WrByte(0, 0x002D, 0x24);
+    I2C_SetDeviceRate(TOF_ADDRESS, I2CBus1000);
+#endif
     tof_status = VL53L1X_SetDistanceMode(0, 1);
-    tof_status = VL53L1X_SetTimingBudgetInMs(0, 500);
-    tof_status = VL53L1X_SetInterMeasurementInMs(0, 500);
+    tof_status = VL53L1X_SetTimingBudgetInMs(0, TOF_PERIOD_MS);
+    tof_status = VL53L1X_SetInterMeasurementInMs(0, TOF_PERIOD_MS);
+#ifdef TOF_GPIO1_IRQ
+    //  GPIO1 active low, it idles high on the pull-up
+    tof_status = VL53L1X_SetInterruptPolarity(0, 0);
+    //  PD3 input with pull-up, INT1 on the falling edge
+    DDRD &= ~(1 << PD3);
+    PORTD |= (1 << PD3);
+    EICRA = (EICRA & ~((1 << ISC11) | (1 << ISC10))) | (1 << ISC11);
+    EIFR = (1 << INTF1);
+    EIMSK |= (1 << INT1);
+#endif
+    //  Range continuously from here on, tof_service collects the samples
+    tof_status = VL53L1X_StartRanging(0);
 }
 
 //  Initialize switch
@@ -284,17 +441,22 @@ void switch_init(void)
 //  Start animation
 void start_Animation(void)
 {
+    //  Splash screen
+    SSD1306_BeginFrame();
+    SSD1306_BlitRLE(0, 0, (PGM_P)splash);
+    SSD1306_EndFrame();
+    _delay_ms(1500);
+
     //  Animation for the OLED display
     // SSD1306_StringXY(0, 0, "Hello!");
-    // Move a circle across the screen
-    for (uint8_t i = 0; i < 128; i += 4)
-    {
-        SSD1306_Clear();
-        SSD1306_Circle(i, 16, 10);
-        SSD1306_Render();
-    }
+    // Move a circle across the screen: drawn once at the left edge, then
+    // the panel scrolls it (about 50 columns/s, no bus traffic)
+    SSD1306_BeginFrame();
+    SSD1306_Circle(10, 16, 10);
+    SSD1306_ScrollH(0, 0, 3, SSD1306_SCROLL_2);
+    _delay_ms(2500);
+    SSD1306_ScrollStop();
     SSD1306_Clear();
-    SSD1306_Render();
 
     //  Animation for the NeoPixel
     set_color(CYAN);
@@ -319,26 +481,111 @@ void start_Animation(void)
     neopixel_update();
 }
 
-//  Check distance with Time of Flight sensor
-void tof_check_distance(void)
+#ifdef OLED_BENCHMARK
+//  Render full frames and report the OLED bus time per frame
+//  and the frame rate the bus allows (Timer 1 ticks are 4 us)
+void oled_benchmark(void)
 {
-    /*Variables*/
-    uint8_t _DataReady = 0;
-    uint8_t _RangeStatus = 0;
-    //  Start continuous ranging measurements
-    tof_status = VL53L1X_StartRanging(0);
-    //  Wait for new measurement
-    while (_DataReady == 0)
+    I2C_Stats before;
+    I2C_Stats after;
+    //  Room for three 10 digit counters and the text
+    char line[64];
+
+    I2C_GetStats(_SSD1306_ADDRESS, &before);
+    for (uint8_t i = 0; i < OLED_BENCHMARK_FRAMES; ++i)
     {
-        tof_status = VL53L1X_CheckForDataReady(0, &_DataReady);
+        //  Fills every page and renders it
+        SSD1306_Noise();
     }
-    tof_status = VL53L1X_GetRangeStatus(0, &_RangeStatus);
-    tof_status = VL53L1X_GetDistance(0, &tof_distance);
-    tof_status = VL53L1X_ClearInterrupt(0);
+    I2C_GetStats(_SSD1306_ADDRESS, &after);
 
-    //  Stop continuous ranging measurements
-    tof_status = VL53L1X_StopRanging(0);
-    
+    unsigned long ticks = (after.ulBusyTicks - before.ulBusyTicks) / OLED_BENCHMARK_FRAMES;
+    unsigned long transactions = (after.ulTransactions - before.ulTransactions) / OLED_BENCHMARK_FRAMES;
+    snprintf(line, sizeof line, "OLED %lu us/frame %lu fps %lu tx\r\n",
+        ticks * 4, ticks ? 250000UL / ticks : 0, transactions);
+    SCI0_TxString(line);
+
+    SSD1306_Clear();
+}
+#endif
+
+#ifdef GFX_BENCHMARK
+//  Timer 1 count, the 16-bit read must not be split by an interrupt
+static uint16_t gfx_ticks(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ticks = TCNT1;
+    SREG = sreg;
+    return ticks;
+}
+
+//  Time circles and lines into the back-buffer and report the CPU cycles
+//  per shape (Timer 1 ticks are 64 cycles, the count wraps after 262 ms)
+void gfx_benchmark(void)
+{
+    char line[48];
+    uint16_t start;
+    uint16_t ticks;
+
+    start = gfx_ticks();
+    for (uint8_t i = 0; i < GFX_BENCHMARK_SHAPES; ++i)
+    {
+        SSD1306_Circle(i * 4, 16, 10);
+    }
+    ticks = gfx_ticks() - start;
+    snprintf(line, sizeof line, "Circle r10 %lu cycles\r\n", (unsigned long)ticks * 64 / GFX_BENCHMARK_SHAPES);
+    SCI0_TxString(line);
+
+    start = gfx_ticks();
+    for (uint8_t i = 0; i < GFX_BENCHMARK_SHAPES; ++i)
+    {
+        SSD1306_Line(0, i, 127, 31 - i);
+    }
+    ticks = gfx_ticks() - start;
+    snprintf(line, sizeof line, "Line 128px %lu cycles\r\n", (unsigned long)ticks * 64 / GFX_BENCHMARK_SHAPES);
+    SCI0_TxString(line);
+
+    SSD1306_Clear();
+}
+#endif
+
+//  Pick up the latest sample from the free-running ToF sensor
+//  Returns 1 and updates tof_distance if there was a new one, costs at most
+//  one data ready poll when there wasn't
+uint8_t tof_service(void)
+{
+    uint8_t ready = 0;
+
+#ifdef TOF_GPIO1_IRQ
+    //  GPIO1 says so, no bus traffic to find out
+    if (tof_ready)
+    {
+        tof_ready = 0;
+        ready = 1;
+    }
+    //  No edge for too long (GPIO1 not wired?), ask the sensor
+    else if ((uint8_t)(timer_ticks - tof_sample_ticks) >= TOF_IRQ_TIMEOUT_TICKS)
+    {
+        tof_status = VL53L1X_CheckForDataReady(0, &ready);
+    }
+#else
+    tof_status = VL53L1X_CheckForDataReady(0, &ready);
+#endif
+    if (!ready)
+    {
+        return 0;
+    }
+
+    //  Status, distance, sigma, signal and ambient in one burst read
+    tof_status = VL53L1X_GetResultEx(0, &tof_result);
+    tof_distance = tof_result.Distance;
+    //  Releases GPIO1, the sensor carries on with the next sample by itself
+    tof_status = VL53L1X_ClearInterrupt(0);
+#ifdef TOF_GPIO1_IRQ
+    tof_sample_ticks = timer_ticks;
+#endif
+    return 1;
 }
 
 //  Go to sleep
@@ -432,11 +679,20 @@ void set_color(color_enum_t color)
 
 /* Interrupt service routines */
 
+#ifdef TOF_GPIO1_IRQ
+//  VL53L1X GPIO1, a new sample is ready
+ISR(INT1_vect)
+{
+    tof_ready = 1;
+}
+#endif
+
 //  Timer interrupt
 ISR(TIMER1_COMPA_vect)
 {
     // rearm the output compare operation   
     OCR1A += 25000; // 100ms intervals 
+    ++timer_ticks;
 
     if (user_is_here)
     {
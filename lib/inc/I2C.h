@@ -1,7 +1,18 @@
-// I2C library, ATmega328P Version
-// Simon Walker, NAIT
-// Revision History:
-// March 18 2022 - Initial Build
+// I2C library, ATmega328P Version
+// Simon Walker, NAIT
+// Revision History:
+// March 18 2022 - Initial Build
+// added interrupt driven transaction queue (I2C_Submit)
+// added register block read/write (I2C_WriteRegs8/16, I2C_ReadRegs8/16)
+// added combined write/read with repeated START (I2C_WriteRead)
+// added bounded waits, bus recovery and fault counters
+// added optional bus tracer (I2C_TRACE)
+// added per device bus rates and Fast-mode Plus
+// added runtime statistics (I2C_GetStats)
+// added register block write from flash (I2C_WriteRegs8_P, I2C_WriteRegs16_P)
+
+#ifndef I2C_H
+#define I2C_H
 
 #define I2C_STOP 1
 #define I2C_NOSTOP 0
@@ -10,32 +21,194 @@
 #define I2C_ACK 1
 #define I2C_NACK 0
 
-// enum for desired I2C bus rate
-typedef enum
-{
-	I2CBus100,  // I2C bus @ 100 kHz
-	I2CBus400   // I2C bus @ 400 kHz
+// transaction status while queued or on the bus
+#define I2C_PENDING 1
+
+// returned when the bus did not respond in time (bus recovery was run)
+#define I2C_ERR_TIMEOUT -4
+
+// how long one bus operation may take, in byte times at the bus rate,
+//  before it is treated as a stuck bus
+#ifndef I2C_TIMEOUT_BYTES
+#define I2C_TIMEOUT_BYTES 10
+#endif
+
+// number of transactions that may be queued at once
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE 4
+#endif
+
+// comment in to build the bus tracer, costs I2C_TRACE_SIZE * 9 bytes of RAM
+//  and a few cycles per byte, compiled out it costs nothing
+// timestamps are raw TCNT1 values, so Timer 1 must be running
+//  (4us per tick with Timer_Init at Timer_Prescale_64 and 16MHz)
+//#define I2C_TRACE
+
+#ifndef I2C_TRACE_SIZE
+#define I2C_TRACE_SIZE 16
+#endif
+
+// number of devices that get their own statistics (first come, first served),
+//  traffic to others still counts in the bus totals
+#ifndef I2C_STATS_DEVICES
+#define I2C_STATS_DEVICES 4
+#endif
+
+// comment in to build I2C_StatsDump, which needs the SCI library
+//#define I2C_STATS_DUMP
+
+// enum for desired I2C bus rate
+// I2CBus1000 is beyond the ATmega328P datasheet, whose TWI is only rated
+//  to 400 kHz; it is there for devices that can take Fast-mode Plus, but
+//  check the SCL timing on a scope with the real pull-ups and bus load
+//  before relying on it
+typedef enum
+{
+	I2CBus100,  // I2C bus @ 100 kHz
+	I2CBus400,  // I2C bus @ 400 kHz
+	I2CBus1000  // I2C bus @ 1 MHz (Fast-mode Plus, TWBR 0 @ 16MHz, out of spec)
 } I2C_BusRate;
 
+// number of devices that can be given their own bus rate
+#ifndef I2C_DEVICE_COUNT
+#define I2C_DEVICE_COUNT 4
+#endif
+
+// transaction descriptor for the interrupt driven engine
+// bus sequence is START, ADDR+W, header bytes, write bytes, then if there
+//  is anything to read, repeated START, ADDR+R, read bytes, then STOP
+// descriptor and buffers must stay valid until iStatus is not I2C_PENDING
+typedef struct I2C_Transaction
+{
+	unsigned char uc7Addr;          // target device
+	unsigned char ucHeader[2];      // register index / control byte(s) sent first
+	unsigned char ucHeaderCount;    // 0 to 2
+	const unsigned char * pWrite;   // bytes to write after the header
+	unsigned int uiWriteCount;
+	unsigned char * pRead;          // destination for read bytes
+	unsigned int uiReadCount;
+	// called from the TWI ISR when the transaction ends, may submit more work
+	void (*pCallback)(struct I2C_Transaction * pTrans);
+	// I2C_PENDING until complete, then 0 or -1/-2/-3/-4 like the blocking calls
+	volatile int iStatus;
+} I2C_Transaction;
+
+// runtime statistics, for the whole bus or one device
+// a transaction runs from START to STOP (repeated STARTs are part of it),
+//  whether blocking or queued
+// busy time is in raw TCNT1 ticks from START to STOP, so it only counts
+//  while Timer 1 is running (4us per tick with Timer_Prescale_64 @ 16MHz)
+typedef struct
+{
+	unsigned long ulTransactions;
+	unsigned long ulBytesWritten;   // data bytes ACKed by the device (no address bytes)
+	unsigned long ulBytesRead;
+	unsigned long ulBusyTicks;
+	unsigned int uiBusErrors;       // -1, START failed, arbitration lost or bus error
+	unsigned int uiAddrNacks;       // -2, address not acknowledged (I2C_Scan adds these)
+	unsigned int uiDataNacks;       // -3, data byte not acknowledged
+	unsigned int uiTimeouts;        // -4, bus stuck, recovery was run
+} I2C_Stats;
+
 // initialize the TWI bus for use
 int I2C_Init (unsigned long ulBusRate, I2C_BusRate sclRate);
 
+// run transactions to this device at a faster rate than the I2C_Init rate
+// TWBR is switched on START only when the target device changes
+// all devices on the bus see the faster clock, so only speed up a device
+//  if the slower ones tolerate traffic at that rate (they won't be
+//  addressed, but must not misread it)
+// call after I2C_Init, returns -1 if the table is full or the rate is
+//  unreachable or slower than the I2C_Init rate
+int I2C_SetDeviceRate (unsigned char uc7Addr, I2C_BusRate sclRate);
+
 // start a transaction with intent to read or write
 int I2C_Start (unsigned char uc7Addr, int bRead);
 
-// read an 8-bit device register (complete transaction)
-//int I2C_ReadRegister8 (unsigned char uc7Addr, unsigned char ucRegister, unsigned char * ucValue);
+// write n-bytes to a device, starting at register (complete transaction)
+// 8-bit register index
+int I2C_WriteRegs8 (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount);
+
+// write n-bytes from flash (PROGMEM) to a device, starting at register
+//  (complete transaction), e.g. a command stream behind a control byte
+// 8-bit register index
+int I2C_WriteRegs8_P (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount);
 
-// write an 8-bit device register (complete transaction)
-// read a 16-bit device register (complete transaction)
-// write a 16-bit device register (complete transaction)
-// read n-bytes from a device, starting at register (complete transaction)
 // write n-bytes to a device, starting at register (complete transaction)
+// 16-bit register index, sent high byte first
+int I2C_WriteRegs16 (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount);
+
+// write n-bytes from flash (PROGMEM) to a device, starting at register
+//  (complete transaction), e.g. a default configuration block
+// 16-bit register index, sent high byte first
+int I2C_WriteRegs16_P (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount);
+
+// read n-bytes from a device, starting at register (complete transaction)
+// 8-bit register index, repeated START between index and data
+int I2C_ReadRegs8 (unsigned char uc7Addr, unsigned char ucReg, unsigned char * pData, unsigned int uiCount);
+
+// read n-bytes from a device, starting at register (complete transaction)
+// 16-bit register index, sent high byte first
+int I2C_ReadRegs16 (unsigned char uc7Addr, unsigned int uiReg, unsigned char * pData, unsigned int uiCount);
+
+// combined transaction: write bytes, repeated START, read bytes, STOP
+// no STOP/START turnaround between the write and read phases
+// a zero uiReadCount makes this a plain write
+int I2C_WriteRead (unsigned char uc7Addr, const unsigned char * pWrite, unsigned int uiWriteCount, unsigned char * pRead, unsigned int uiReadCount);
 
 // scan all 7-bit addresses and report ones found on the bus
 // requires 128-byte buffer for results
 void I2C_Scan (unsigned char * results);
 
+// queue a transaction for the interrupt driven engine
+// returns immediately, -1 if the queue is full
+// global interrupts should be enabled, or use I2C_Wait to drive the engine
+// a blocking call made while work is queued waits only for the transaction
+//  on the bus, the engine resumes the queue after the blocking call's STOP
+int I2C_Submit (I2C_Transaction * pTrans);
+
+// non-zero while queued transactions remain
+int I2C_Busy (void);
+
+// block until the transaction completes, returns its final status
+int I2C_Wait (I2C_Transaction * pTrans);
+
+// release a stuck bus: clock SCL by hand until the slave lets go of SDA,
+//  send a STOP, then re-run I2C_Init with the last settings
+// queued transactions are failed with I2C_ERR_TIMEOUT
+// runs automatically on any timeout, returns -1 if SDA/SCL are still held
+int I2C_Recover (void);
+
+// how often the fault paths have fired since reset
+// timeouts, recovery runs, and recoveries that could not free the bus
+void I2C_GetFaultCounts (unsigned int * puiTimeouts, unsigned int * puiRecoveries, unsigned int * puiRecoverFails);
+
+// copy the statistics for a device, or the whole bus with address 0
+// returns -1 (and zeroes) for a device without its own statistics
+int I2C_GetStats (unsigned char uc7Addr, I2C_Stats * pStats);
+
+// zero all statistics and forget the devices seen
+void I2C_ResetStats (void);
+
+#ifdef I2C_STATS_DUMP
+// stream the statistics over SCI0 (SCI0_Init first), one line per device
+//  then the bus totals, all decimal
+// ADDR TRANS WRITTEN READ BUSY ERR ANACK DNACK TIMEOUT
+void I2C_StatsDump (void);
+#endif
+
+#ifdef I2C_TRACE
+// add a marker to the trace, e.g. either side of SSD1306_Render, so the
+//  bus time of a piece of code can be read off the dump
+void I2C_TraceMark (unsigned char ucTag);
+
+// stream the trace over SCI0 (SCI0_Init first) and empty it
+void I2C_TraceDump (void);
+#else
+#define I2C_TraceMark(tag)
+#define I2C_TraceDump()
+#endif
+
 // private(ish)helper methods:
 // write a byte to an open transaction
 int I2C_Write8 (unsigned char ucData, int bStop);
@@ -44,3 +217,4 @@ int I2C_Write8 (unsigned char ucData, int bStop);
 int I2C_Read8 (unsigned char *ucData, int bAck, int bStop);
 // end helper methods
 
+#endif
@@ -0,0 +1,98 @@
+// I2C library, host simulation version
+// Stands in for I2C328P.c so the drivers (SSD1306, LM75A, VL53L1X API and
+//  platform) can be built and exercised on a PC, against register level
+//  models of the devices on the ComputerNany bus.
+//
+// build on the host with the AVR header stand-ins from lib/sim, e.g.
+//  gcc -Ilib/inc -Ilib/sim -I<API>/core -I<API>/platform
+//      host_main.c lib/src/I2CSim.c lib/src/SSD1306.c lib/src/LM75A.c
+//      <API>/core/VL53L1X_api.c <API>/platform/vl53l1_platform.c
+//  where <API> is ComputerNany/ComputerNany/API
+// tests/host builds it that way and checks the bus cost of the I2C calls,
+//  SSD1306 and the VL53L1X API (make -C tests/host)
+//
+// every I2C.h call completes immediately (I2C_Submit runs the transaction
+//  and its callback before returning), and the models count what crossed
+//  the bus so bus cost per driver call can be checked.
+
+#ifndef I2CSIM_H
+#define I2CSIM_H
+
+#include "I2C.h"
+
+// addresses the models answer on, anything else NACKs
+#define I2CSIM_SSD1306_ADDR 0x3C
+#define I2CSIM_VL53L1X_ADDR 0x29
+#define I2CSIM_LM75A_ADDR   0x48
+
+// bus activity, per device or for the whole bus
+typedef struct
+{
+	unsigned long ulTransactions;  // START ... STOP (repeated STARTs don't add)
+	unsigned long ulStarts;        // STARTs and repeated STARTs
+	unsigned long ulBytesWritten;  // data bytes to the device (not the address)
+	unsigned long ulBytesRead;     // data bytes from the device
+	unsigned long ulNacks;         // address or data bytes not acknowledged
+} I2CSim_Counts;
+
+// all models back to power-on state, counters cleared
+void I2CSim_Reset (void);
+
+// clear the counters only
+void I2CSim_ClearCounts (void);
+
+// counters for one device address, or the whole bus with address 0
+void I2CSim_GetCounts (unsigned char uc7Addr, I2CSim_Counts * pCounts);
+
+// take a device off the bus (it NACKs its address) or put it back
+void I2CSim_SetPresent (unsigned char uc7Addr, int bPresent);
+
+// SSD1306 model
+// GDDRAM as the panel holds it, 8 pages of 128 columns
+const unsigned char * I2CSim_SSD1306_GDDRAM (void);
+
+// last state set by commands
+typedef struct
+{
+	unsigned char bDisplayOn;
+	unsigned char ucAddrMode;      // 0 horizontal, 1 vertical, 2 page
+	unsigned char ucColStart, ucColEnd, ucPageStart, ucPageEnd;
+	unsigned char ucCol, ucPage;   // RAM pointer
+	unsigned char bScrolling;      // 0x2F active, 0x2E stops
+	unsigned char ucScrollCmd;     // last scroll setup command (0x26/0x27/0x29/0x2A)
+	unsigned char ucScrollStart, ucScrollEnd;  // page range of that setup
+	unsigned long ulCommandBytes;  // command stream bytes (incl. parameters)
+	unsigned long ulDataBytes;     // GDDRAM bytes written
+	unsigned long ulScrollWrites;  // GDDRAM writes while scrolling (datasheet says don't)
+} I2CSim_SSD1306_State;
+
+void I2CSim_SSD1306_GetState (I2CSim_SSD1306_State * pState);
+
+// VL53L1X model
+// distances (mm) served in order, one per sample; the last one repeats
+void I2CSim_VL53L1X_SetTrace (const unsigned int * puiDistances, unsigned int uiCount);
+
+// reads of GPIO__TIO_HV_STATUS before a started measurement reports ready
+// (0 is ready on the first poll), stands in for the timing budget
+void I2CSim_VL53L1X_SetReadyDelay (unsigned int uiPolls);
+
+// finish the measurement in progress now, as if the timing budget ran out
+// returns 1 if a new sample became ready
+int I2CSim_VL53L1X_Measure (void);
+
+// level of the GPIO1 interrupt output (follows the polarity in 0x30)
+int I2CSim_VL53L1X_GPIO1 (void);
+
+// direct register access, no bus traffic counted
+unsigned char I2CSim_VL53L1X_GetReg (unsigned int uiIndex);
+void I2CSim_VL53L1X_SetReg (unsigned int uiIndex, unsigned char ucValue);
+
+// samples produced, and data ready polls seen, since reset
+unsigned long I2CSim_VL53L1X_Samples (void);
+unsigned long I2CSim_VL53L1X_Polls (void);
+
+// LM75A model
+// raw temperature register, left aligned 11-bit (0x1900 is 25.0C)
+void I2CSim_LM75A_SetTemp (unsigned int uiRaw);
+
+#endif
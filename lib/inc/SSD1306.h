@@ -23,23 +23,106 @@
 //#endif
 // comment in/out the appropriate size of your display! ****
 
+// keep a copy of what the panel holds so Render sends only the bytes that
+//  changed, costs a second copy of the display in RAM (512 bytes on 128x32),
+//  comment out to save it
+// 128x32 only: on 128x64 it is another 1KB on top of the 1KB back-buffer,
+//  which is all of the ATmega328P's 2KB SRAM
+#ifdef _SSD1306_DisplaySize128x32
+#ifndef _SSD1306_SHADOW
+#define _SSD1306_SHADOW
+#endif
+#endif
+
+#if defined(_SSD1306_DisplaySize128x64) && defined(_SSD1306_SHADOW)
+#error "_SSD1306_SHADOW on 128x64 needs 1KB more RAM, with the back-buffer that is all of the ATmega328P's SRAM"
+#endif
+
 // management
 void SSD1306_DispInit (void);
 void SSD1306_Noise (void);
 void SSD1306_Clear (void);
 void SSD1306_Render (void);
+
+// frame drawing: BeginFrame clears the back-buffer only, EndFrame renders
+//  the result, so the panel sees one update per frame and never a blank one
+// (SSD1306_Clear clears and renders at once)
+void SSD1306_BeginFrame (void);
+void SSD1306_EndFrame (void);
+
+// background render: returns at once and the frame is sent from the TWI
+//  interrupt, drawing may go on meanwhile (it lands in the next frame)
+// other display calls wait for it to finish
+// needs _SSD1306_SHADOW (the snapshot it sends from), else it renders in
+//  the foreground
+void SSD1306_RenderAsync (void);
+int SSD1306_RenderBusy (void);
 int SSD1306_IsDirty (void);
 void SSD1306_DisplayOn (void);
 void SSD1306_DisplayOff (void);
 
+// hardware scrolling, the panel moves its own RAM with no bus traffic
+//  after the setup
+// ScrollH/ScrollDiag render what is pending, then scroll pages ucPageStart
+//  to ucPageEnd one column per ucInterval (SSD1306_SCROLL_x frames),
+//  ScrollDiag also moves the whole display up ucRowOffset rows per step
+// while scrolling, renders hold (drawing stays in the back-buffer), and
+//  ScrollStop resends the scrolled pages as the back-buffer has them
+void SSD1306_ScrollH (int bLeft, unsigned char ucPageStart, unsigned char ucPageEnd, unsigned char ucInterval);
+void SSD1306_ScrollDiag (int bLeft, unsigned char ucPageStart, unsigned char ucPageEnd, unsigned char ucInterval, unsigned char ucRowOffset);
+void SSD1306_ScrollStop (void);
+int SSD1306_Scrolling (void);
+
+// scroll step intervals in frames, as the datasheet codes them
+#define SSD1306_SCROLL_2   0x07
+#define SSD1306_SCROLL_3   0x04
+#define SSD1306_SCROLL_4   0x05
+#define SSD1306_SCROLL_5   0x00
+#define SSD1306_SCROLL_25  0x06
+#define SSD1306_SCROLL_64  0x01
+#define SSD1306_SCROLL_128 0x02
+#define SSD1306_SCROLL_256 0x03
+
 // string
 void SSD1306_CharXY (unsigned char iX, unsigned char iY, char disp);
 void SSD1306_StringXY (unsigned char iX, unsigned char iY, char * pStr);
 
+// string in flash, e.g. SSD1306_StringXY_P(0, 0, PSTR("Distance: "))
+void SSD1306_StringXY_P (unsigned char iX, unsigned char iY, PGM_P pStr);
+
+// numbers drawn straight into the back-buffer without printf, zero padded
+//  to ucDigits whole digits (0 for none), no wrapping
+// FixedXY takes uiValue in units of the last decimal place (452 with
+//  ucDecimals 1 draws 45.2)
+// both return the column after the last character, for what follows
+unsigned char SSD1306_DecimalXY (unsigned char iX, unsigned char iY, unsigned int uiValue, unsigned char ucDigits);
+unsigned char SSD1306_FixedXY (unsigned char iX, unsigned char iY, unsigned int uiValue, unsigned char ucDecimals, unsigned char ucDigits);
+
+// large 16 x 24 digits and ':' (8 wide) for the clock, iX in pixels, iPage
+//  the top of the 3 pages used, BigCharXY returns the width drawn
+int SSD1306_BigCharXY (unsigned char iX, unsigned char iPage, char disp);
+void SSD1306_BigStringXY (unsigned char iX, unsigned char iPage, char * pStr);
+
 // graphics
 void SSD1306_SetPixel (int iX, int iY);
 void SSD1306_Line (int iXS, int iYS, int iXE, int iYE);
-void SSD1306_Circle (int iXS, int iYS, float fRad);
+void SSD1306_Circle (int iXS, int iYS, int iRad);
+
+// filled shapes, clipped to the display, written a page byte at a time
+// (a span within one page is one masked OR per column, not a SetPixel per
+//  pixel), ClearRect turns pixels off
+void SSD1306_FillRect (int iX, int iY, int iWidth, int iHeight);
+void SSD1306_ClearRect (int iX, int iY, int iWidth, int iHeight);
+void SSD1306_HLine (int iX, int iY, int iWidth);
+void SSD1306_VLine (int iX, int iY, int iHeight);
+
+// outlined bar filled in proportion to uiValue / uiMax
+void SSD1306_ProgressBar (int iX, int iY, int iWidth, int iHeight, unsigned int uiValue, unsigned int uiMax);
 
 // requires the page data to be in flash
 void SSD1306_SetPage (int page, PGM_P buff);
+
+// RLE compressed (or stored, if that is smaller) bitmap from flash (made
+//  with tools/rle_encode.py), top left at column iX of page iPage, clipped
+//  to the display
+void SSD1306_BlitRLE (int iX, int iPage, PGM_P pAsset);
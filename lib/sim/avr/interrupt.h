@@ -0,0 +1,10 @@
+// host stand-in for <avr/interrupt.h>, see I2CSim.h
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#define sei()
+#define cli()
+#define ISR(vector) void vector (void)
+
+#endif
@@ -0,0 +1,9 @@
+// host stand-in for <avr/io.h>, see I2CSim.h
+// the drivers built against I2CSim.c only need the header to exist
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#endif
@@ -0,0 +1,19 @@
+// host stand-in for <avr/pgmspace.h>, see I2CSim.h
+// flash and RAM share one address space on the host
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define pgm_read_word(addr) (*(const unsigned short *)(addr))
+
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+#define strlen_P(s) strlen(s)
+
+#endif
@@ -0,0 +1,10 @@
+// host stand-in for <util/delay.h>, see I2CSim.h
+// simulated devices answer at once, so delays are empty
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#define _delay_ms(ms) ((void)(ms))
+#define _delay_us(us) ((void)(us))
+
+#endif
@@ -2,8 +2,133 @@
 // Simon Walker, NAIT
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "I2C.h"
 
+#if defined(I2C_TRACE) || defined(I2C_STATS_DUMP)
+#include "sci.h"
+#endif
+
+#ifdef I2C_STATS_DUMP
+#include <stdio.h>
+#endif
+
+#ifdef I2C_TRACE
+
+// trace ring, one entry per START (repeated STARTs get their own entry)
+typedef struct
+{
+	unsigned int uiStart;     // TCNT1 when START was issued
+	unsigned int uiEnd;       // TCNT1 at the last TWINT of this phase
+	unsigned int uiBytes;     // data bytes moved (not counting the address)
+	unsigned char uc7Addr;    // 0xFF for marks from I2C_TraceMark
+	unsigned char bRead;      // direction, or the mark tag
+	unsigned char ucStatus;   // last TWSR status seen
+} I2C_TraceEntry;
+
+static I2C_TraceEntry _I2C_Trace [I2C_TRACE_SIZE];
+static volatile unsigned char _I2C_TraceHead = 0;    // next slot to write
+static volatile unsigned char _I2C_TraceCount = 0;
+
+static void I2C_TraceStart (unsigned char uc7Addr, unsigned char bRead);
+static void I2C_TraceStep (void);
+#define I2C_TRACE_START(a, r) I2C_TraceStart((a), (r))
+#define I2C_TRACE_STEP() I2C_TraceStep()
+#else
+#define I2C_TRACE_START(a, r)
+#define I2C_TRACE_STEP()
+#endif
+
+// interrupt driven engine state
+// queue holds pointers to caller owned descriptors, head is on the bus
+static I2C_Transaction * volatile _I2C_Queue [I2C_QUEUE_SIZE];
+static volatile unsigned char _I2C_QHead = 0;
+static volatile unsigned char _I2C_QCount = 0;
+
+// progress through the head transaction (header + write bytes, or read bytes)
+static volatile unsigned int _I2C_uiIndex = 0;
+static volatile unsigned char _I2C_bReading = 0;
+
+// set while a blocking transaction holds the bus (START issued, no STOP yet)
+static volatile unsigned char _I2C_bPolled = 0;
+
+// set while the engine has the bus (START issued, final STOP not yet)
+static volatile unsigned char _I2C_bRunning = 0;
+
+// set while a blocking call waits for the bus, the engine stops after the
+//  transaction it is on instead of starting the next one
+static volatile unsigned char _I2C_bYield = 0;
+
+// bumped on every TWINT the engine services, lets waiters see progress
+static volatile unsigned char _I2C_ucEvents = 0;
+
+// settings from I2C_Init, kept so recovery can restore them
+static unsigned long _I2C_ulBusRate = 0;
+static I2C_BusRate _I2C_sclRate = I2CBus100;
+
+// poll budget for one bus operation, and half an SCL period for
+//  manual clocking, both derived from the rates in I2C_Init
+static unsigned int _I2C_uiTimeout = 0xFFFF;
+static unsigned int _I2C_uiHalfBit = 20;
+
+// per device bus rates, devices not in the table run at the I2C_Init rate
+typedef struct
+{
+	unsigned char uc7Addr;
+	unsigned char ucTWBR;
+} I2C_Device;
+
+static I2C_Device _I2C_Devices [I2C_DEVICE_COUNT];
+static unsigned char _I2C_ucDeviceCount = 0;
+static unsigned char _I2C_ucDefaultTWBR = 0;
+
+// device the current TWBR was chosen for (0xFF forces a lookup)
+static volatile unsigned char _I2C_ucRateAddr = 0xFF;
+
+// fault counters
+static volatile unsigned int _I2C_uiTimeouts = 0;
+static volatile unsigned int _I2C_uiRecoveries = 0;
+static volatile unsigned int _I2C_uiRecoverFails = 0;
+
+// runtime statistics, bus totals and one slot per device seen
+typedef struct
+{
+	unsigned char uc7Addr;
+	I2C_Stats stats;
+} I2C_DeviceStats;
+
+static I2C_Stats _I2C_Stats;
+static I2C_DeviceStats _I2C_DevStats [I2C_STATS_DEVICES];
+static unsigned char _I2C_ucDevStatsCount = 0;
+
+// transaction on the bus (0xFF when none), TCNT1 at its START, and the
+//  data bytes moved so far
+static volatile unsigned char _I2C_ucStatAddr = 0xFF;
+static volatile unsigned int _I2C_uiStatStart = 0;
+static volatile unsigned int _I2C_uiStatTx = 0;
+static volatile unsigned int _I2C_uiStatRx = 0;
+
+// why the open blocking transaction is being stopped (0 for success)
+static int _I2C_iStopStatus = 0;
+
+static void I2C_Service (void);
+static void I2C_Kick (void);
+static void I2C_Drain (void);
+static void I2C_Stop (void);
+static int I2C_Timeout (void);
+static int I2C_Fail (int iErr);
+static void I2C_StatsBegin (unsigned char uc7Addr);
+static void I2C_StatsEnd (int iStatus);
+static int I2C_RateTWBR (I2C_BusRate sclRate, unsigned char * pucTWBR);
+static unsigned char I2C_DeviceTWBR (unsigned char uc7Addr);
+static void I2C_SelectDevice (unsigned char uc7Addr);
+static inline int I2C_WaitInt (void);
+static int I2C_EngineWait (I2C_Transaction * pTrans);
+static int I2C_OpenReg (unsigned char uc7Addr, unsigned int uiReg, int bWide);
+static int I2C_WriteBlock (const unsigned char * pData, unsigned int uiCount, int bStop, int bFlash);
+static int I2C_ReadBlock (unsigned char * pData, unsigned int uiCount);
+
 // not sure why there is a prescale greater than 1, as the bus rate
 //  won't typically be greater than 16MHz, and the I2C rate won't
 //  be slower than 100kHz, unless the user wants to run the I2C rate
@@ -15,63 +140,170 @@ int I2C_Init (unsigned long ulBusRate, I2C_BusRate sclRate)
 	// ensure power is on : TWI
 	PRR &= 0b01111111;
 
-	float fac = 0;
+	// remember for recovery
+	_I2C_ulBusRate = ulBusRate;
+	_I2C_sclRate = sclRate;
+
+	// manual recovery clocks at 100kHz or slower, ~4 cycles per delay pass
+	_I2C_uiHalfBit = (unsigned int)(ulBusRate / 800000UL) + 1;
+
+	unsigned char ucTWBR;
+	if (I2C_RateTWBR(sclRate, &ucTWBR))
+		return -1;
+
+	// one byte is 9 SCL periods, allow I2C_TIMEOUT_BYTES of those per
+	//  operation (covers clock stretching), a poll loop pass is ~8 cycles
+	// per device rates are never slower than this, so the budget holds
+	unsigned long ulLoops = (16UL + 2 * ucTWBR) * 9 * I2C_TIMEOUT_BYTES / 8;
+	_I2C_uiTimeout = (ulLoops > 0xFFFF) ? 0xFFFF : (unsigned int)ulLoops + 1;
+
+	// set rate, devices in the table switch to their own on START
+	_I2C_ucDefaultTWBR = ucTWBR;
+	_I2C_ucRateAddr = 0xFF;
+	TWBR = ucTWBR;
+
+	// power on I2C to grab module pins
+	TWCR |= 0b00000100;
 
-  // precision here isn't necessary
+	return 0;
+}
+
+// work out TWBR for a bus rate (prescale 1), -1 if it won't fit
+static int I2C_RateTWBR (I2C_BusRate sclRate, unsigned char * pucTWBR)
+{
+	unsigned long ulRate = 100000;
+
+	// integer only, so no float routines get linked for this
 	switch (sclRate)
 	{
 		case I2CBus100:
-			fac = ((ulBusRate / 2.0f) / 100000.0f) - 8;
+			ulRate = 100000;
 			break;
 		case I2CBus400:
-			fac = ((ulBusRate / 2.0f) / 400000.0f) - 8;
+			ulRate = 400000;
+			break;
+		case I2CBus1000:
+			ulRate = 1000000;
 			break;
 	}
 
-	// fac must fit into 8 bits
-	if (fac < 1 || fac > 255)
+	// SCL = bus rate / (16 + 2 * TWBR), so TWBR = (bus / SCL - 16) / 2
+	unsigned long ulDiv = _I2C_ulBusRate / ulRate;
+
+	// TWBR must fit into 8 bits
+	// (zero is legal, it is what 1MHz needs at 16MHz)
+	if (ulDiv < 16 || (ulDiv - 16) / 2 > 255)
 		return -1;
 
-	// set rate
-	TWBR = (unsigned char)fac;
+	*pucTWBR = (unsigned char)((ulDiv - 16) / 2);
+	return 0;
+}
 
-	// power on I2C to grab module pins
-	TWCR |= 0b00000100;
+int I2C_SetDeviceRate (unsigned char uc7Addr, I2C_BusRate sclRate)
+{
+	unsigned char ucTWBR;
+	unsigned char i;
 
+	if (I2C_RateTWBR(sclRate, &ucTWBR))
+		return -1;
+
+	// slower than the I2C_Init rate would outlast the timeout budget
+	if (ucTWBR > _I2C_ucDefaultTWBR)
+		return -1;
+
+	// update in place if already known
+	for (i = 0; i < _I2C_ucDeviceCount; ++i)
+		if (_I2C_Devices[i].uc7Addr == uc7Addr)
+			break;
+
+	if (i == _I2C_ucDeviceCount)
+	{
+		if (_I2C_ucDeviceCount >= I2C_DEVICE_COUNT)
+			return -1;
+		++_I2C_ucDeviceCount;
+	}
+
+	_I2C_Devices[i].uc7Addr = uc7Addr;
+	_I2C_Devices[i].ucTWBR = ucTWBR;
+
+	// rate for this device may have changed
+	_I2C_ucRateAddr = 0xFF;
 	return 0;
 }
 
+// TWBR for a device, table entry or the I2C_Init default
+static unsigned char I2C_DeviceTWBR (unsigned char uc7Addr)
+{
+	for (unsigned char i = 0; i < _I2C_ucDeviceCount; ++i)
+		if (_I2C_Devices[i].uc7Addr == uc7Addr)
+			return _I2C_Devices[i].ucTWBR;
+
+	return _I2C_ucDefaultTWBR;
+}
+
+// set the bus rate for the next transaction, bus must be idle
+// nothing to do when the target is the same device as last time
+static void I2C_SelectDevice (unsigned char uc7Addr)
+{
+	if (uc7Addr == _I2C_ucRateAddr)
+		return;
+
+	_I2C_ucRateAddr = uc7Addr;
+	unsigned char ucTWBR = I2C_DeviceTWBR(uc7Addr);
+	if (TWBR != ucTWBR)
+		TWBR = ucTWBR;
+}
+
 // assume 128-byte buffer provided for scan results
 void I2C_Scan (unsigned char * results)
 {
 	for (unsigned char addr = 0x01; addr <= 0x7E; ++addr)
 	{
 		if (!I2C_Start(addr, I2C_WRITE))
-			results[addr] = addr;			
+		{
+			results[addr] = addr;
+			I2C_Stop();
+		}
 		else
-			results[addr] = 0;				
-
-		// send stop
-		TWCR = 0b10010100;
-
-		// wait for stop to automatically clear (stop completed)
-		while (TWCR & 0x10)
-		;
+			results[addr] = 0;
 	}
 }
 
 int I2C_Start (unsigned char uc7Addr, int bRead)
 {
+	// the engine hands over the bus at the end of its current transaction,
+	//  whatever is still queued resumes at our STOP (a repeated START in an
+	//  open blocking transaction doesn't need to wait)
+	if (!_I2C_bPolled)
+	{
+		_I2C_bYield = 1;
+		I2C_Drain();
+		_I2C_bPolled = 1;
+		_I2C_bYield = 0;
+
+		// the engine's STOP may still be going out
+		unsigned int uiLoops = _I2C_uiTimeout;
+		while ((TWCR & 0x10) && --uiLoops)
+			;
+
+		// bus is idle, safe to change rate for this device
+		I2C_SelectDevice(uc7Addr);
+		I2C_StatsBegin(uc7Addr);
+	}
+	_I2C_bPolled = 1;
+
+	I2C_TRACE_START(uc7Addr, bRead);
+
 	// send start
 	TWCR = 0b10100100;
 	
 	// wait for operation to complete
-	while (!(TWCR & 0x80))
-	  ;
+	if (I2C_WaitInt())
+		return I2C_ERR_TIMEOUT;
 
 	// ensure status says START sent (or restart?)
 	if (!((TWSR & 0b11111000) == 0x08 || (TWSR & 0b11111000) == 0x10))
-	  return -1;
+		return I2C_Fail(-1);
 
 	// now send address with read or write
 	if (bRead)
@@ -87,12 +319,12 @@ int I2C_Start (unsigned char uc7Addr, int bRead)
 		TWCR = 0b10000100;
 		
 		// wait for operation to complete
-		while (!(TWCR & 0x80))
-		  ;
+		if (I2C_WaitInt())
+			return I2C_ERR_TIMEOUT;
 
 		// look for ADDR+R sent with ACK
 		if ((TWSR & 0b11111000) != 0x40)
-		  return -2;
+			return I2C_Fail(-2);
 	}
 	else
 	{
@@ -107,12 +339,12 @@ int I2C_Start (unsigned char uc7Addr, int bRead)
 		TWCR = 0b10000100;
 		
 		// wait for operation to complete
-		while (!(TWCR & 0x80))
-		  ;
+		if (I2C_WaitInt())
+			return I2C_ERR_TIMEOUT;
 
 		// look for ADDR+W sent with ACK
 		if ((TWSR & 0b11111000) != 0x18)
-		  return -2;
+			return I2C_Fail(-2);
 	}
 
 	return 0;
@@ -128,35 +360,29 @@ int I2C_Read8 (unsigned char *ucData, int bAck, int bStop)
 	  TWCR = 0b10000100;
 
 	// look for data sent, with TWINT bit
-	while (!(TWCR & 0x80))
-	  ;
+	if (I2C_WaitInt())
+		return I2C_ERR_TIMEOUT;
 
 	if (bAck)
 	{
 		// look for data received, ack returned
 		if ((TWSR & 0b11111000) != 0x50)
-		  return -3;
+			return I2C_Fail(-3);
 	}
 	else
 	{
 		// look for data received, ack not returned
 		if ((TWSR & 0b11111000) != 0x58)
-		  return -3;
+			return I2C_Fail(-3);
 	}
 
 	// read the data byte
 	*ucData = TWDR;
+	++_I2C_uiStatRx;
 	
 	// if stop requested, send it
 	if (bStop)
-	{
-		// send STOP
-		TWCR = 0b10010100;
-
-		// wait for stop to automatically clear (stop completed)
-		while (TWCR & 0x10)
-			;
-	}
+		I2C_Stop();
 
 	return 0;
 }
@@ -171,24 +397,805 @@ int I2C_Write8 (unsigned char ucData, int bStop)
 	TWCR = 0b10000100;
 	
 	// look for data sent, with TWINT bit
-	while (!(TWCR & 0x80))
-	  ;
+	if (I2C_WaitInt())
+		return I2C_ERR_TIMEOUT;
 
 	// look for data sent with ACK
 	if ((TWSR & 0b11111000) != 0x28)
-	  return -3;
+		return I2C_Fail(-3);
+	++_I2C_uiStatTx;
 	
 	// if stop requested, send it
 	if (bStop)
+		I2C_Stop();
+
+	return 0;
+}
+
+int I2C_WriteRegs8 (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount)
+{
+	int iErr = I2C_OpenReg(uc7Addr, ucReg, 0);
+	if (iErr)
+		return iErr;
+
+	return I2C_WriteBlock(pData, uiCount, I2C_STOP, 0);
+}
+
+int I2C_WriteRegs8_P (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount)
+{
+	int iErr = I2C_OpenReg(uc7Addr, ucReg, 0);
+	if (iErr)
+		return iErr;
+
+	return I2C_WriteBlock(pData, uiCount, I2C_STOP, 1);
+}
+
+int I2C_WriteRegs16 (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount)
+{
+	int iErr = I2C_OpenReg(uc7Addr, uiReg, 1);
+	if (iErr)
+		return iErr;
+
+	return I2C_WriteBlock(pData, uiCount, I2C_STOP, 0);
+}
+
+int I2C_WriteRegs16_P (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount)
+{
+	int iErr = I2C_OpenReg(uc7Addr, uiReg, 1);
+	if (iErr)
+		return iErr;
+
+	return I2C_WriteBlock(pData, uiCount, I2C_STOP, 1);
+}
+
+int I2C_ReadRegs8 (unsigned char uc7Addr, unsigned char ucReg, unsigned char * pData, unsigned int uiCount)
+{
+	return I2C_WriteRead(uc7Addr, &ucReg, 1, pData, uiCount);
+}
+
+int I2C_ReadRegs16 (unsigned char uc7Addr, unsigned int uiReg, unsigned char * pData, unsigned int uiCount)
+{
+	unsigned char ucIndex[2];
+
+	ucIndex[0] = (unsigned char)(uiReg >> 8);
+	ucIndex[1] = (unsigned char)uiReg;
+
+	return I2C_WriteRead(uc7Addr, ucIndex, 2, pData, uiCount);
+}
+
+int I2C_WriteRead (unsigned char uc7Addr, const unsigned char * pWrite, unsigned int uiWriteCount, unsigned char * pRead, unsigned int uiReadCount)
+{
+	int iErr = I2C_Start(uc7Addr, I2C_WRITE);
+	if (iErr)
+		return iErr;
+
+	// no STOP after the write phase if there is something to read
+	iErr = I2C_WriteBlock(pWrite, uiWriteCount, uiReadCount ? I2C_NOSTOP : I2C_STOP, 0);
+	if (iErr || !uiReadCount)
+		return iErr;
+
+	// turn the bus around with a repeated START (status 0x10)
+	if ((iErr = I2C_Start(uc7Addr, I2C_READ)))
+		return iErr;
+
+	return I2C_ReadBlock(pRead, uiReadCount);
+}
+
+// start a write transaction and send the register index
+// bWide sends a 16-bit index, high byte first
+static int I2C_OpenReg (unsigned char uc7Addr, unsigned int uiReg, int bWide)
+{
+	int iErr = I2C_Start(uc7Addr, I2C_WRITE);
+	if (iErr)
+		return iErr;
+
+	if (bWide && (iErr = I2C_Write8((unsigned char)(uiReg >> 8), I2C_NOSTOP)))
+		return iErr;
+
+	return I2C_Write8((unsigned char)uiReg, I2C_NOSTOP);
+}
+
+// stream bytes into an open write transaction, optionally STOP after
+// register access is inlined here rather than going through I2C_Write8,
+//  so the gap between bytes on the wire is only a few instructions
+// bFlash reads the bytes from program memory
+static int I2C_WriteBlock (const unsigned char * pData, unsigned int uiCount, int bStop, int bFlash)
+{
+	while (uiCount--)
 	{
-		// send STOP
-		TWCR = 0b10010100;
+		TWDR = bFlash ? pgm_read_byte(pData) : *pData;
+		++pData;
+
+		// clear TWINT, no START, keep TWI enabled
+		TWCR = 0b10000100;
+		if (I2C_WaitInt())
+			return I2C_ERR_TIMEOUT;
+
+		// look for data sent with ACK
+		if ((TWSR & 0b11111000) != 0x28)
+			return I2C_Fail(-3);
+		++_I2C_uiStatTx;
+	}
+
+	if (bStop)
+		I2C_Stop();
+	return 0;
+}
+
+// read bytes from an open read transaction, then STOP
+// every byte is ACKed except the last, which is NACKed to end the read
+static int I2C_ReadBlock (unsigned char * pData, unsigned int uiCount)
+{
+	while (uiCount--)
+	{
+		if (uiCount)
+			TWCR = 0b11000100;
+		else
+			TWCR = 0b10000100;
+
+		if (I2C_WaitInt())
+			return I2C_ERR_TIMEOUT;
+
+		// data received, ACK (0x50) or NACK (0x58) as requested
+		if ((TWSR & 0b11111000) != (uiCount ? 0x50 : 0x58))
+			return I2C_Fail(-3);
+
+		*pData++ = TWDR;
+		++_I2C_uiStatRx;
+	}
+
+	I2C_Stop();
+	return 0;
+}
+
+// end an open blocking transaction, then hand the bus to anything
+//  that was queued while it was held
+static void I2C_Stop (void)
+{
+	// send STOP
+	TWCR = 0b10010100;
 
-		// wait for stop to automatically clear (stop completed)
-		while (TWCR & 0x10)
+	// wait for stop to automatically clear (stop completed)
+	unsigned int uiLoops = _I2C_uiTimeout;
+	while (TWCR & 0x10)
+	{
+		if (!--uiLoops)
+		{
+			// recovery re-inits the bus and flushes the queue
+			I2C_Timeout();
+			return;
+		}
+	}
+
+	I2C_StatsEnd(_I2C_iStopStatus);
+	_I2C_iStopStatus = 0;
+
+	// release and kick as one step, or an I2C_Submit from an ISR in
+	//  between could see the bus free too and START it a second time
+	unsigned char ucSREG = SREG;
+	cli();
+
+	_I2C_bPolled = 0;
+	if (_I2C_QCount)
+		I2C_Kick();
+
+	SREG = ucSREG;
+}
+
+// a blocking step failed, record why and release the bus
+static int I2C_Fail (int iErr)
+{
+	_I2C_iStopStatus = iErr;
+	I2C_Stop();
+
+	return iErr;
+}
+
+// poll for TWINT, bounded by the timeout computed in I2C_Init
+static inline int I2C_WaitInt (void)
+{
+	unsigned int uiLoops = _I2C_uiTimeout;
+
+	while (!(TWCR & 0x80))
+	{
+		if (!--uiLoops)
+			return I2C_Timeout();
+	}
+
+	I2C_TRACE_STEP();
+	return 0;
+}
+
+// an operation ran out of time, count it and free the bus
+static int I2C_Timeout (void)
+{
+	++_I2C_uiTimeouts;
+	I2C_Recover();
+
+	return I2C_ERR_TIMEOUT;
+}
+
+int I2C_Recover (void)
+{
+	unsigned char ucSREG = SREG;
+	int iResult = 0;
+
+	cli();
+	++_I2C_uiRecoveries;
+
+	// let go of the pins, TWI off
+	TWCR = 0;
+	PORTC &= 0b11001111;  // SDA (PC4), SCL (PC5) drive low when output
+	DDRC &= 0b11001111;   // released, external pull-ups take them high
+
+	// a slave holding SDA low is part way through a byte, clock it out
+	//  (at most 9 clocks) until it lets go
+	for (unsigned char i = 0; i < 9 && !(PINC & 0b00010000); ++i)
+	{
+		DDRC |= 0b00100000;   // SCL low
+		for (volatile unsigned int d = _I2C_uiHalfBit; d; --d)
 			;
+		DDRC &= 0b11011111;   // SCL released
+		for (volatile unsigned int d = _I2C_uiHalfBit; d; --d)
+			;
+	}
+
+	// generate a STOP by hand: SDA low, then release SDA while SCL is high
+	DDRC |= 0b00010000;
+	for (volatile unsigned int d = _I2C_uiHalfBit; d; --d)
+		;
+	DDRC &= 0b11101111;
+	for (volatile unsigned int d = _I2C_uiHalfBit; d; --d)
+		;
+
+	if (!(PINC & 0b00010000) || !(PINC & 0b00100000))
+	{
+		// still held, nothing more software can do
+		++_I2C_uiRecoverFails;
+		iResult = -1;
+	}
+
+	// whatever was on the bus ends here
+	I2C_StatsEnd(I2C_ERR_TIMEOUT);
+	_I2C_iStopStatus = 0;
+
+	// back to normal TWI operation
+	TWCR = 0;
+	I2C_Init(_I2C_ulBusRate, _I2C_sclRate);
+	_I2C_bPolled = 0;
+	_I2C_bRunning = 0;
+
+	// fail what the engine was holding, callbacks may queue new work
+	//  so only the entries present now are flushed
+	unsigned char ucFlush = _I2C_QCount;
+	while (ucFlush--)
+	{
+		I2C_Transaction * pTrans = _I2C_Queue[_I2C_QHead];
+		_I2C_QHead = (_I2C_QHead + 1) % I2C_QUEUE_SIZE;
+		--_I2C_QCount;
+
+		pTrans->iStatus = I2C_ERR_TIMEOUT;
+		if (pTrans->pCallback)
+			pTrans->pCallback(pTrans);
 	}
+	if (_I2C_QCount && !_I2C_bYield)
+		I2C_Kick();
+
+	SREG = ucSREG;
+	return iResult;
+}
+
+void I2C_GetFaultCounts (unsigned int * puiTimeouts, unsigned int * puiRecoveries, unsigned int * puiRecoverFails)
+{
+	unsigned char ucSREG = SREG;
+	cli();
+
+	*puiTimeouts = _I2C_uiTimeouts;
+	*puiRecoveries = _I2C_uiRecoveries;
+	*puiRecoverFails = _I2C_uiRecoverFails;
+
+	SREG = ucSREG;
+}
+
+int I2C_Submit (I2C_Transaction * pTrans)
+{
+	// the ISR (and completion callbacks) also touch the queue
+	unsigned char ucSREG = SREG;
+	cli();
+
+	if (_I2C_QCount >= I2C_QUEUE_SIZE)
+	{
+		SREG = ucSREG;
+		return -1;
+	}
+
+	pTrans->iStatus = I2C_PENDING;
+	_I2C_Queue[(_I2C_QHead + _I2C_QCount) % I2C_QUEUE_SIZE] = pTrans;
+
+	++_I2C_QCount;
 
+	// engine idle and bus free, so get it going
+	// (if a blocking transaction has or wants the bus, its STOP will start us)
+	if (!_I2C_bRunning && !_I2C_bPolled && !_I2C_bYield)
+		I2C_Kick();
+
+	SREG = ucSREG;
 	return 0;
 }
 
+int I2C_Busy (void)
+{
+	return _I2C_QCount != 0;
+}
+
+int I2C_Wait (I2C_Transaction * pTrans)
+{
+	return I2C_EngineWait(pTrans);
+}
+
+// wait for the engine to let go of the bus
+// must not be called from a completion callback
+static void I2C_Drain (void)
+{
+	I2C_EngineWait(0);
+}
+
+// wait for one transaction, or for the engine to stop if pTrans is NULL
+// times out if the engine makes no progress for a full operation budget
+static int I2C_EngineWait (I2C_Transaction * pTrans)
+{
+	unsigned char ucSeen = _I2C_ucEvents;
+	unsigned int uiLoops = _I2C_uiTimeout;
+
+	while (pTrans ? pTrans->iStatus == I2C_PENDING : _I2C_bRunning)
+	{
+		// with global interrupts off the engine has to be polled
+		if (!(SREG & 0x80) && (TWCR & 0x80))
+			I2C_Service();
+
+		if (ucSeen != _I2C_ucEvents)
+		{
+			ucSeen = _I2C_ucEvents;
+			uiLoops = _I2C_uiTimeout;
+		}
+		else if (!--uiLoops)
+		{
+			// fails everything queued, including pTrans
+			I2C_Timeout();
+			break;
+		}
+	}
+
+	return pTrans ? pTrans->iStatus : 0;
+}
+
+// reset progress for the head of the queue
+// pure reads skip the ADDR+W phase entirely
+static void I2C_Prepare (void)
+{
+	I2C_Transaction * pTrans = _I2C_Queue[_I2C_QHead];
+
+	_I2C_uiIndex = 0;
+	_I2C_bReading = !pTrans->ucHeaderCount && !pTrans->uiWriteCount && pTrans->uiReadCount;
+}
+
+// put the head of the queue on the bus
+static void I2C_Kick (void)
+{
+	// previous STOP may still be going out, let it finish before TWBR
+	//  changes (idle bus only) and before this device's busy time starts
+	// (if it never clears the START stalls and the waiter times out)
+	unsigned int uiLoops = _I2C_uiTimeout;
+	while ((TWCR & 0x10) && --uiLoops)
+		;
+
+	I2C_Prepare();
+	I2C_SelectDevice(_I2C_Queue[_I2C_QHead]->uc7Addr);
+	I2C_StatsBegin(_I2C_Queue[_I2C_QHead]->uc7Addr);
+	_I2C_bRunning = 1;
+
+	// send START, interrupt enabled, the ISR takes it from here
+	TWCR = 0b10100101;
+}
+
+// head transaction is done, report it and move on
+static void I2C_Finish (int iStatus)
+{
+	I2C_Transaction * pTrans = _I2C_Queue[_I2C_QHead];
+
+	I2C_StatsEnd(iStatus);
+
+	// callback runs while this entry is still queued, so anything it
+	//  submits is only queued and not started underneath us
+	pTrans->iStatus = iStatus;
+	if (pTrans->pCallback)
+		pTrans->pCallback(pTrans);
+
+	_I2C_QHead = (_I2C_QHead + 1) % I2C_QUEUE_SIZE;
+	--_I2C_QCount;
+
+	// a blocking call waiting for the bus goes next, the rest of the queue
+	//  restarts at its STOP
+	if (_I2C_QCount && !_I2C_bYield)
+	{
+		I2C_Prepare();
+
+		unsigned char uc7Next = _I2C_Queue[_I2C_QHead]->uc7Addr;
+		if (uc7Next == _I2C_ucRateAddr || I2C_DeviceTWBR(uc7Next) == TWBR)
+		{
+			// same rate, send STOP followed by START, keep interrupt on
+			_I2C_ucRateAddr = uc7Next;
+			I2C_StatsBegin(uc7Next);
+			TWCR = 0b10110101;
+		}
+		else
+		{
+			// TWBR may only change on an idle bus, so let the STOP
+			//  finish first (one bit time), then START at the new rate
+			TWCR = 0b10010100;
+			unsigned int uiLoops = _I2C_uiTimeout;
+			while ((TWCR & 0x10) && --uiLoops)
+				;
+			I2C_SelectDevice(uc7Next);
+			I2C_StatsBegin(uc7Next);
+			TWCR = 0b10100101;
+		}
+	}
+	else
+	{
+		// send STOP, interrupt off (blocking calls poll TWINT)
+		TWCR = 0b10010100;
+		_I2C_bRunning = 0;
+	}
+}
+
+// one step of the transaction state machine, runs on each TWINT
+static void I2C_Service (void)
+{
+	I2C_Transaction * pTrans = _I2C_Queue[_I2C_QHead];
+	unsigned int uiIndex = _I2C_uiIndex;
+
+	++_I2C_ucEvents;
+	I2C_TRACE_STEP();
+
+	switch (TWSR & 0b11111000)
+	{
+		// START or repeated START sent, send address with direction
+		case 0x08:
+		case 0x10:
+			I2C_TRACE_START(pTrans->uc7Addr, _I2C_bReading);
+			TWDR = (pTrans->uc7Addr << 1) | _I2C_bReading;
+			TWCR = 0b10000101;
+			break;
+
+		// ADDR+W or data byte sent with ACK, send the next byte
+		case 0x28:
+			++_I2C_uiStatTx;
+			// fall through
+		case 0x18:
+			if (uiIndex < pTrans->ucHeaderCount)
+			{
+				TWDR = pTrans->ucHeader[uiIndex];
+				_I2C_uiIndex = uiIndex + 1;
+				TWCR = 0b10000101;
+			}
+			else if (uiIndex - pTrans->ucHeaderCount < pTrans->uiWriteCount)
+			{
+				TWDR = pTrans->pWrite[uiIndex - pTrans->ucHeaderCount];
+				_I2C_uiIndex = uiIndex + 1;
+				TWCR = 0b10000101;
+			}
+			else if (pTrans->uiReadCount)
+			{
+				// switch direction with a repeated START
+				_I2C_uiIndex = 0;
+				_I2C_bReading = 1;
+				TWCR = 0b10100101;
+			}
+			else
+				I2C_Finish(0);
+			break;
+
+		// ADDR+R sent with ACK, ACK incoming bytes until the last one
+		case 0x40:
+			if (pTrans->uiReadCount > 1)
+				TWCR = 0b11000101;
+			else
+				TWCR = 0b10000101;
+			break;
+
+		// data received, ACK returned, more to come
+		case 0x50:
+			pTrans->pRead[uiIndex++] = TWDR;
+			++_I2C_uiStatRx;
+			_I2C_uiIndex = uiIndex;
+			if (uiIndex < pTrans->uiReadCount - 1)
+				TWCR = 0b11000101;
+			else
+				TWCR = 0b10000101;
+			break;
+
+		// data received, NACK returned, that was the last byte
+		case 0x58:
+			pTrans->pRead[uiIndex] = TWDR;
+			++_I2C_uiStatRx;
+			I2C_Finish(0);
+			break;
+
+		// ADDR+W / ADDR+R sent, no ACK
+		case 0x20:
+		case 0x48:
+			I2C_Finish(-2);
+			break;
+
+		// data sent, no ACK
+		case 0x30:
+			I2C_Finish(-3);
+			break;
+
+		// arbitration lost or bus error
+		default:
+			I2C_Finish(-1);
+			break;
+	}
+}
+
+ISR (TWI_vect)
+{
+	I2C_Service();
+}
+
+// a transaction has its START on the way
+static void I2C_StatsBegin (unsigned char uc7Addr)
+{
+	// TCNT1 is a 16-bit read, keep the timer ISR off the TEMP register
+	unsigned char ucSREG = SREG;
+	cli();
+
+	_I2C_ucStatAddr = uc7Addr;
+	_I2C_uiStatStart = TCNT1;
+	_I2C_uiStatTx = 0;
+	_I2C_uiStatRx = 0;
+
+	SREG = ucSREG;
+}
+
+static void I2C_StatsAdd (I2C_Stats * pStats, int iStatus, unsigned int uiTicks)
+{
+	++pStats->ulTransactions;
+	pStats->ulBytesWritten += _I2C_uiStatTx;
+	pStats->ulBytesRead += _I2C_uiStatRx;
+	pStats->ulBusyTicks += uiTicks;
+
+	switch (iStatus)
+	{
+		case -1:
+			++pStats->uiBusErrors;
+			break;
+		case -2:
+			++pStats->uiAddrNacks;
+			break;
+		case -3:
+			++pStats->uiDataNacks;
+			break;
+		case I2C_ERR_TIMEOUT:
+			++pStats->uiTimeouts;
+			break;
+	}
+}
+
+static I2C_DeviceStats * I2C_FindStats (unsigned char uc7Addr)
+{
+	for (unsigned char i = 0; i < _I2C_ucDevStatsCount; ++i)
+		if (_I2C_DevStats[i].uc7Addr == uc7Addr)
+			return &_I2C_DevStats[i];
+
+	return 0;
+}
+
+// the open transaction is over (STOP sent), fold it into the totals
+static void I2C_StatsEnd (int iStatus)
+{
+	unsigned char ucSREG = SREG;
+	cli();
+
+	if (_I2C_ucStatAddr != 0xFF)
+	{
+		unsigned int uiTicks = TCNT1 - _I2C_uiStatStart;
+		I2C_DeviceStats * pDev = I2C_FindStats(_I2C_ucStatAddr);
+
+		// a device gets a slot once it has acknowledged its address,
+		//  so I2C_Scan doesn't fill the table with empty addresses
+		if (!pDev && (iStatus == 0 || iStatus == -3) && _I2C_ucDevStatsCount < I2C_STATS_DEVICES)
+		{
+			pDev = &_I2C_DevStats[_I2C_ucDevStatsCount++];
+			pDev->uc7Addr = _I2C_ucStatAddr;
+			pDev->stats = (I2C_Stats){ 0 };
+		}
+
+		I2C_StatsAdd(&_I2C_Stats, iStatus, uiTicks);
+		if (pDev)
+			I2C_StatsAdd(&pDev->stats, iStatus, uiTicks);
+
+		_I2C_ucStatAddr = 0xFF;
+	}
+
+	SREG = ucSREG;
+}
+
+int I2C_GetStats (unsigned char uc7Addr, I2C_Stats * pStats)
+{
+	int iResult = 0;
+	unsigned char ucSREG = SREG;
+	cli();
+
+	if (!uc7Addr)
+		*pStats = _I2C_Stats;
+	else
+	{
+		I2C_DeviceStats * pDev = I2C_FindStats(uc7Addr);
+		if (pDev)
+			*pStats = pDev->stats;
+		else
+		{
+			*pStats = (I2C_Stats){ 0 };
+			iResult = -1;
+		}
+	}
+
+	SREG = ucSREG;
+	return iResult;
+}
+
+void I2C_ResetStats (void)
+{
+	unsigned char ucSREG = SREG;
+	cli();
+
+	_I2C_Stats = (I2C_Stats){ 0 };
+	_I2C_ucDevStatsCount = 0;
+
+	SREG = ucSREG;
+}
+
+#ifdef I2C_STATS_DUMP
+static void I2C_StatsLine (char * pszName, const I2C_Stats * pStats)
+{
+	char buff[96];
+
+	(void)sprintf(buff, "%s %lu %lu %lu %lu %u %u %u %u\r\n", pszName,
+		pStats->ulTransactions, pStats->ulBytesWritten, pStats->ulBytesRead,
+		pStats->ulBusyTicks, pStats->uiBusErrors, pStats->uiAddrNacks,
+		pStats->uiDataNacks, pStats->uiTimeouts);
+	SCI0_TxString(buff);
+}
+
+void I2C_StatsDump (void)
+{
+	I2C_Stats stats;
+	char szAddr[5];
+
+	for (unsigned char i = 0; i < _I2C_ucDevStatsCount; ++i)
+	{
+		unsigned char uc7Addr = _I2C_DevStats[i].uc7Addr;
+
+		(void)sprintf(szAddr, "0x%2.2X", uc7Addr);
+		I2C_GetStats(uc7Addr, &stats);
+		I2C_StatsLine(szAddr, &stats);
+	}
+
+	I2C_GetStats(0, &stats);
+	I2C_StatsLine("ALL", &stats);
+}
+#endif
+
+#ifdef I2C_TRACE
+// claim the next ring slot (oldest entry is overwritten when full)
+static I2C_TraceEntry * I2C_TraceNext (void)
+{
+	I2C_TraceEntry * pEntry = &_I2C_Trace[_I2C_TraceHead];
+
+	_I2C_TraceHead = (_I2C_TraceHead + 1) % I2C_TRACE_SIZE;
+	if (_I2C_TraceCount < I2C_TRACE_SIZE)
+		++_I2C_TraceCount;
+
+	return pEntry;
+}
+
+// most recent entry, the one TWINT steps are added to
+static I2C_TraceEntry * I2C_TraceLast (void)
+{
+	return &_I2C_Trace[(_I2C_TraceHead + I2C_TRACE_SIZE - 1) % I2C_TRACE_SIZE];
+}
+
+static void I2C_TraceStart (unsigned char uc7Addr, unsigned char bRead)
+{
+	unsigned char ucSREG = SREG;
+	cli();
+
+	I2C_TraceEntry * pEntry = I2C_TraceNext();
+	pEntry->uiStart = TCNT1;
+	pEntry->uiEnd = pEntry->uiStart;
+	pEntry->uiBytes = 0;
+	pEntry->uc7Addr = uc7Addr;
+	pEntry->bRead = bRead;
+	pEntry->ucStatus = 0;
+
+	SREG = ucSREG;
+}
+
+// called after every TWINT, data bytes are counted by their status
+// START/repeated START belong to the entry I2C_TraceStart opens
+static void I2C_TraceStep (void)
+{
+	unsigned char ucStatus = TWSR & 0b11111000;
+	if (ucStatus == 0x08 || ucStatus == 0x10)
+		return;
+
+	unsigned char ucSREG = SREG;
+	cli();
+
+	I2C_TraceEntry * pEntry = I2C_TraceLast();
+	pEntry->uiEnd = TCNT1;
+	pEntry->ucStatus = ucStatus;
+
+	// data sent (ACK/NACK) or data received (ACK/NACK)
+	if (ucStatus == 0x28 || ucStatus == 0x30 || ucStatus == 0x50 || ucStatus == 0x58)
+		++pEntry->uiBytes;
+
+	SREG = ucSREG;
+}
+
+void I2C_TraceMark (unsigned char ucTag)
+{
+	unsigned char ucSREG = SREG;
+	cli();
+
+	I2C_TraceEntry * pEntry = I2C_TraceNext();
+	pEntry->uiStart = TCNT1;
+	pEntry->uiEnd = pEntry->uiStart;
+	pEntry->uiBytes = 0;
+	pEntry->uc7Addr = 0xFF;
+	pEntry->bRead = ucTag;
+	pEntry->ucStatus = 0;
+
+	SREG = ucSREG;
+}
+
+// one line per entry, oldest first, then the ring is emptied
+// ADDR DIR BYTES STATUS START TICKS   (marks: MARK TAG START)
+void I2C_TraceDump (void)
+{
+	while (_I2C_TraceCount)
+	{
+		I2C_TraceEntry entry;
+		unsigned char ucSREG = SREG;
+		cli();
+
+		// take a copy of the oldest entry, SCI is slow
+		entry = _I2C_Trace[(_I2C_TraceHead + I2C_TRACE_SIZE - _I2C_TraceCount) % I2C_TRACE_SIZE];
+		--_I2C_TraceCount;
+
+		SREG = ucSREG;
+
+		if (entry.uc7Addr == 0xFF)
+		{
+			SCI0_TxString("MARK ");
+			SCI0_Tx16H(entry.bRead, 0);
+			SCI0_TxString(" ");
+			SCI0_Tx16H(entry.uiStart, 1);
+			continue;
+		}
+
+		SCI0_Tx16H(entry.uc7Addr, 0);
+		SCI0_TxString(entry.bRead ? " R " : " W ");
+		SCI0_Tx16H(entry.uiBytes, 0);
+		SCI0_TxString(" ");
+		SCI0_Tx16H(entry.ucStatus, 0);
+		SCI0_TxString(" ");
+		SCI0_Tx16H(entry.uiStart, 0);
+		SCI0_TxString(" ");
+		SCI0_Tx16H(entry.uiEnd - entry.uiStart, 1);
+	}
+}
+#endif
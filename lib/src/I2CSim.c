@@ -0,0 +1,1011 @@
+// I2C library, host simulation version
+// replaces I2C328P.c on a PC build, see I2CSim.h
+
+#include <stdio.h>
+#include <string.h>
+#include "I2C.h"
+#include "I2CSim.h"
+
+// a device model on the simulated bus
+typedef struct
+{
+	unsigned char uc7Addr;
+	unsigned char bPresent;
+	void (*pStart)(int bRead);
+	int (*pWrite)(unsigned char ucData);   // 0 for ACK
+	unsigned char (*pRead)(void);
+	void (*pStop)(void);
+	I2CSim_Counts counts;
+	unsigned int uiBitNs;          // SCL period from I2C_SetDeviceRate, 0 for the default
+	I2C_Stats stats;
+} I2CSim_Device;
+
+static void SSD_Start (int bRead);
+static int SSD_Write (unsigned char ucData);
+static unsigned char SSD_Read (void);
+static void SSD_Stop (void);
+static void SSD_Reset (void);
+
+static void VL_Start (int bRead);
+static int VL_Write (unsigned char ucData);
+static unsigned char VL_Read (void);
+static void VL_Stop (void);
+static void VL_Reset (void);
+
+static void LM_Start (int bRead);
+static int LM_Write (unsigned char ucData);
+static unsigned char LM_Read (void);
+static void LM_Stop (void);
+static void LM_Reset (void);
+
+static I2CSim_Device _Devices [] =
+{
+	{ I2CSIM_SSD1306_ADDR, 1, SSD_Start, SSD_Write, SSD_Read, SSD_Stop, { 0 }, 0, { 0 } },
+	{ I2CSIM_VL53L1X_ADDR, 1, VL_Start, VL_Write, VL_Read, VL_Stop, { 0 }, 0, { 0 } },
+	{ I2CSIM_LM75A_ADDR, 1, LM_Start, LM_Write, LM_Read, LM_Stop, { 0 }, 0, { 0 } },
+};
+#define I2CSIM_DEVICES (sizeof(_Devices) / sizeof(_Devices[0]))
+
+// whole bus counters
+static I2CSim_Counts _Bus;
+static I2C_Stats _Stats;
+
+// SCL period from I2C_Init
+static unsigned int _uiBitNs = 10000;
+
+// transaction being timed for I2C_GetStats (0xFF when none)
+static unsigned char _ucStatAddr = 0xFF;
+static unsigned long _ulStatNs = 0;
+static unsigned int _uiStatTx = 0;
+static unsigned int _uiStatRx = 0;
+
+// device in the open transaction (NULL when the bus is idle)
+static I2CSim_Device * _pOpen = 0;
+
+// transaction queue, same semantics as the interrupt driven engine
+static I2C_Transaction * _Queue [I2C_QUEUE_SIZE];
+static unsigned char _ucQHead = 0;
+static unsigned char _ucQCount = 0;
+static unsigned char _bRunning = 0;
+
+static I2CSim_Device * I2CSim_Find (unsigned char uc7Addr)
+{
+	for (unsigned int i = 0; i < I2CSIM_DEVICES; ++i)
+		if (_Devices[i].uc7Addr == uc7Addr)
+			return &_Devices[i];
+
+	return 0;
+}
+
+static unsigned int I2CSim_RateNs (I2C_BusRate sclRate)
+{
+	switch (sclRate)
+	{
+		case I2CBus400:
+			return 2500;
+		case I2CBus1000:
+			return 1000;
+		default:
+			return 10000;
+	}
+}
+
+// bus time for a number of SCL periods at the rate of the open transaction
+static void I2CSim_Clocks (unsigned int uiBits)
+{
+	I2CSim_Device * pDev = I2CSim_Find(_ucStatAddr);
+
+	_ulStatNs += (unsigned long)uiBits * ((pDev && pDev->uiBitNs) ? pDev->uiBitNs : _uiBitNs);
+}
+
+static void I2CSim_StatsAdd (I2C_Stats * pStats, int iStatus, unsigned long ulTicks)
+{
+	++pStats->ulTransactions;
+	pStats->ulBytesWritten += _uiStatTx;
+	pStats->ulBytesRead += _uiStatRx;
+	pStats->ulBusyTicks += ulTicks;
+
+	switch (iStatus)
+	{
+		case -1:
+			++pStats->uiBusErrors;
+			break;
+		case -2:
+			++pStats->uiAddrNacks;
+			break;
+		case -3:
+			++pStats->uiDataNacks;
+			break;
+		case I2C_ERR_TIMEOUT:
+			++pStats->uiTimeouts;
+			break;
+	}
+}
+
+// STOP, ends the open transaction with its final status
+// busy time is reported in 4us ticks, as Timer 1 at prescale 64 would
+static void I2CSim_Stop (int iStatus)
+{
+	if (_pOpen)
+		_pOpen->pStop();
+	_pOpen = 0;
+
+	if (_ucStatAddr == 0xFF)
+		return;
+
+	I2CSim_Clocks(1);
+	I2CSim_Device * pDev = I2CSim_Find(_ucStatAddr);
+	unsigned long ulTicks = _ulStatNs / 4000;
+
+	I2CSim_StatsAdd(&_Stats, iStatus, ulTicks);
+	if (pDev && (pDev->stats.ulTransactions || iStatus == 0 || iStatus == -3))
+		I2CSim_StatsAdd(&pDev->stats, iStatus, ulTicks);
+
+	_ucStatAddr = 0xFF;
+}
+
+// --------------------------------------------------------------------------
+// I2C.h
+
+int I2C_Init (unsigned long ulBusRate, I2C_BusRate sclRate)
+{
+	(void)ulBusRate;
+
+	I2CSim_Stop(0);
+	_uiBitNs = I2CSim_RateNs(sclRate);
+	return 0;
+}
+
+int I2C_SetDeviceRate (unsigned char uc7Addr, I2C_BusRate sclRate)
+{
+	I2CSim_Device * pDev = I2CSim_Find(uc7Addr);
+
+	// same rule as the hardware, never slower than the I2C_Init rate
+	if (I2CSim_RateNs(sclRate) > _uiBitNs)
+		return -1;
+
+	if (pDev)
+		pDev->uiBitNs = I2CSim_RateNs(sclRate);
+	return 0;
+}
+
+int I2C_Start (unsigned char uc7Addr, int bRead)
+{
+	I2CSim_Device * pDev = I2CSim_Find(uc7Addr);
+
+	++_Bus.ulStarts;
+
+	// START while a transaction is open is a repeated START
+	if (!_pOpen)
+		++_Bus.ulTransactions;
+	else if (_pOpen != pDev)
+		I2CSim_Stop(0);
+
+	if (_ucStatAddr == 0xFF)
+	{
+		_ucStatAddr = uc7Addr;
+		_ulStatNs = 0;
+		_uiStatTx = 0;
+		_uiStatRx = 0;
+	}
+
+	// START and the address byte
+	I2CSim_Clocks(10);
+
+	if (!pDev || !pDev->bPresent)
+	{
+		++_Bus.ulNacks;
+		I2CSim_Stop(-2);
+		return -2;
+	}
+
+	++pDev->counts.ulStarts;
+	if (_pOpen != pDev)
+		++pDev->counts.ulTransactions;
+
+	_pOpen = pDev;
+	pDev->pStart(bRead);
+
+	return 0;
+}
+
+int I2C_Write8 (unsigned char ucData, int bStop)
+{
+	if (!_pOpen)
+		return -3;
+
+	++_Bus.ulBytesWritten;
+	++_pOpen->counts.ulBytesWritten;
+	I2CSim_Clocks(9);
+
+	if (_pOpen->pWrite(ucData))
+	{
+		++_Bus.ulNacks;
+		++_pOpen->counts.ulNacks;
+		I2CSim_Stop(-3);
+		return -3;
+	}
+	++_uiStatTx;
+
+	if (bStop)
+		I2CSim_Stop(0);
+
+	return 0;
+}
+
+int I2C_Read8 (unsigned char *ucData, int bAck, int bStop)
+{
+	(void)bAck;
+
+	if (!_pOpen)
+		return -3;
+
+	++_Bus.ulBytesRead;
+	++_pOpen->counts.ulBytesRead;
+	I2CSim_Clocks(9);
+	*ucData = _pOpen->pRead();
+	++_uiStatRx;
+
+	if (bStop)
+		I2CSim_Stop(0);
+
+	return 0;
+}
+
+// index bytes then data, one transaction
+static int I2CSim_WriteBlock (unsigned char uc7Addr, const unsigned char * pIndex, unsigned char ucIndexCount, const unsigned char * pData, unsigned int uiCount)
+{
+	int iErr = I2C_Start(uc7Addr, I2C_WRITE);
+	if (iErr)
+		return iErr;
+
+	for (unsigned char i = 0; i < ucIndexCount; ++i)
+		if ((iErr = I2C_Write8(pIndex[i], I2C_NOSTOP)))
+			return iErr;
+
+	for (unsigned int i = 0; i < uiCount; ++i)
+		if ((iErr = I2C_Write8(pData[i], I2C_NOSTOP)))
+			return iErr;
+
+	I2CSim_Stop(0);
+	return 0;
+}
+
+int I2C_WriteRegs8 (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount)
+{
+	return I2CSim_WriteBlock(uc7Addr, &ucReg, 1, pData, uiCount);
+}
+
+// flash and RAM are the same thing on the host
+int I2C_WriteRegs8_P (unsigned char uc7Addr, unsigned char ucReg, const unsigned char * pData, unsigned int uiCount)
+{
+	return I2CSim_WriteBlock(uc7Addr, &ucReg, 1, pData, uiCount);
+}
+
+int I2C_WriteRegs16 (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount)
+{
+	unsigned char ucIndex[2] = { (unsigned char)(uiReg >> 8), (unsigned char)uiReg };
+
+	return I2CSim_WriteBlock(uc7Addr, ucIndex, 2, pData, uiCount);
+}
+
+int I2C_WriteRegs16_P (unsigned char uc7Addr, unsigned int uiReg, const unsigned char * pData, unsigned int uiCount)
+{
+	return I2C_WriteRegs16(uc7Addr, uiReg, pData, uiCount);
+}
+
+int I2C_ReadRegs8 (unsigned char uc7Addr, unsigned char ucReg, unsigned char * pData, unsigned int uiCount)
+{
+	return I2C_WriteRead(uc7Addr, &ucReg, 1, pData, uiCount);
+}
+
+int I2C_ReadRegs16 (unsigned char uc7Addr, unsigned int uiReg, unsigned char * pData, unsigned int uiCount)
+{
+	unsigned char ucIndex[2] = { (unsigned char)(uiReg >> 8), (unsigned char)uiReg };
+
+	return I2C_WriteRead(uc7Addr, ucIndex, 2, pData, uiCount);
+}
+
+int I2C_WriteRead (unsigned char uc7Addr, const unsigned char * pWrite, unsigned int uiWriteCount, unsigned char * pRead, unsigned int uiReadCount)
+{
+	int iErr = I2C_Start(uc7Addr, I2C_WRITE);
+	if (iErr)
+		return iErr;
+
+	for (unsigned int i = 0; i < uiWriteCount; ++i)
+		if ((iErr = I2C_Write8(pWrite[i], I2C_NOSTOP)))
+			return iErr;
+
+	if (!uiReadCount)
+	{
+		I2CSim_Stop(0);
+		return 0;
+	}
+
+	if ((iErr = I2C_Start(uc7Addr, I2C_READ)))
+		return iErr;
+
+	for (unsigned int i = 0; i < uiReadCount; ++i)
+		I2C_Read8(&pRead[i], i < uiReadCount - 1, i == uiReadCount - 1);
+
+	return 0;
+}
+
+void I2C_Scan (unsigned char * results)
+{
+	for (unsigned char addr = 0x01; addr <= 0x7E; ++addr)
+	{
+		if (!I2C_Start(addr, I2C_WRITE))
+		{
+			results[addr] = addr;
+			I2CSim_Stop(0);
+		}
+		else
+			results[addr] = 0;
+	}
+}
+
+// one queued transaction, as the TWI engine would sequence it
+static int I2CSim_Run (I2C_Transaction * pTrans)
+{
+	int iErr;
+
+	// pure reads go straight to ADDR+R
+	if (pTrans->ucHeaderCount || pTrans->uiWriteCount || !pTrans->uiReadCount)
+	{
+		if ((iErr = I2C_Start(pTrans->uc7Addr, I2C_WRITE)))
+			return iErr;
+
+		for (unsigned char i = 0; i < pTrans->ucHeaderCount; ++i)
+			if ((iErr = I2C_Write8(pTrans->ucHeader[i], I2C_NOSTOP)))
+				return iErr;
+
+		for (unsigned int i = 0; i < pTrans->uiWriteCount; ++i)
+			if ((iErr = I2C_Write8(pTrans->pWrite[i], I2C_NOSTOP)))
+				return iErr;
+	}
+
+	if (pTrans->uiReadCount)
+	{
+		if ((iErr = I2C_Start(pTrans->uc7Addr, I2C_READ)))
+			return iErr;
+
+		for (unsigned int i = 0; i < pTrans->uiReadCount; ++i)
+			I2C_Read8(&pTrans->pRead[i], i < pTrans->uiReadCount - 1, I2C_NOSTOP);
+	}
+
+	I2CSim_Stop(0);
+	return 0;
+}
+
+int I2C_Submit (I2C_Transaction * pTrans)
+{
+	if (_ucQCount >= I2C_QUEUE_SIZE)
+		return -1;
+
+	pTrans->iStatus = I2C_PENDING;
+	_Queue[(_ucQHead + _ucQCount) % I2C_QUEUE_SIZE] = pTrans;
+	++_ucQCount;
+
+	// submitted from a callback, runs after the current one
+	if (_bRunning)
+		return 0;
+
+	_bRunning = 1;
+	while (_ucQCount)
+	{
+		I2C_Transaction * pHead = _Queue[_ucQHead];
+
+		pHead->iStatus = I2CSim_Run(pHead);
+		if (pHead->pCallback)
+			pHead->pCallback(pHead);
+
+		_ucQHead = (_ucQHead + 1) % I2C_QUEUE_SIZE;
+		--_ucQCount;
+	}
+	_bRunning = 0;
+
+	return 0;
+}
+
+int I2C_Busy (void)
+{
+	return _ucQCount != 0;
+}
+
+int I2C_Wait (I2C_Transaction * pTrans)
+{
+	return pTrans->iStatus;
+}
+
+int I2C_Recover (void)
+{
+	I2CSim_Stop(0);
+	return 0;
+}
+
+void I2C_GetFaultCounts (unsigned int * puiTimeouts, unsigned int * puiRecoveries, unsigned int * puiRecoverFails)
+{
+	*puiTimeouts = 0;
+	*puiRecoveries = 0;
+	*puiRecoverFails = 0;
+}
+
+int I2C_GetStats (unsigned char uc7Addr, I2C_Stats * pStats)
+{
+	I2CSim_Device * pDev = I2CSim_Find(uc7Addr);
+
+	if (!uc7Addr)
+		*pStats = _Stats;
+	else if (pDev && pDev->stats.ulTransactions)
+		*pStats = pDev->stats;
+	else
+	{
+		memset(pStats, 0, sizeof(*pStats));
+		return -1;
+	}
+
+	return 0;
+}
+
+void I2C_ResetStats (void)
+{
+	memset(&_Stats, 0, sizeof(_Stats));
+	for (unsigned int i = 0; i < I2CSIM_DEVICES; ++i)
+		memset(&_Devices[i].stats, 0, sizeof(_Devices[i].stats));
+}
+
+#ifdef I2C_STATS_DUMP
+static void I2CSim_StatsLine (const char * pszName, const I2C_Stats * pStats)
+{
+	printf("%s %lu %lu %lu %lu %u %u %u %u\n", pszName,
+		pStats->ulTransactions, pStats->ulBytesWritten, pStats->ulBytesRead,
+		pStats->ulBusyTicks, pStats->uiBusErrors, pStats->uiAddrNacks,
+		pStats->uiDataNacks, pStats->uiTimeouts);
+}
+
+// same format as the target, on stdout
+void I2C_StatsDump (void)
+{
+	char szAddr[8];
+
+	for (unsigned int i = 0; i < I2CSIM_DEVICES; ++i)
+	{
+		if (!_Devices[i].stats.ulTransactions)
+			continue;
+
+		sprintf(szAddr, "0x%2.2X", _Devices[i].uc7Addr);
+		I2CSim_StatsLine(szAddr, &_Devices[i].stats);
+	}
+
+	I2CSim_StatsLine("ALL", &_Stats);
+}
+#endif
+
+#ifdef I2C_TRACE
+void I2C_TraceMark (unsigned char ucTag)
+{
+	(void)ucTag;
+}
+
+void I2C_TraceDump (void)
+{
+}
+#endif
+
+// --------------------------------------------------------------------------
+// simulation control
+
+void I2CSim_Reset (void)
+{
+	_pOpen = 0;
+	_ucQHead = 0;
+	_ucQCount = 0;
+	_bRunning = 0;
+	_ucStatAddr = 0xFF;
+	_uiBitNs = 10000;
+
+	for (unsigned int i = 0; i < I2CSIM_DEVICES; ++i)
+	{
+		_Devices[i].bPresent = 1;
+		_Devices[i].uiBitNs = 0;
+	}
+
+	SSD_Reset();
+	VL_Reset();
+	LM_Reset();
+	I2CSim_ClearCounts();
+	I2C_ResetStats();
+}
+
+void I2CSim_ClearCounts (void)
+{
+	memset(&_Bus, 0, sizeof(_Bus));
+	for (unsigned int i = 0; i < I2CSIM_DEVICES; ++i)
+		memset(&_Devices[i].counts, 0, sizeof(_Devices[i].counts));
+}
+
+void I2CSim_GetCounts (unsigned char uc7Addr, I2CSim_Counts * pCounts)
+{
+	I2CSim_Device * pDev = I2CSim_Find(uc7Addr);
+
+	if (!uc7Addr)
+		*pCounts = _Bus;
+	else if (pDev)
+		*pCounts = pDev->counts;
+	else
+		memset(pCounts, 0, sizeof(*pCounts));
+}
+
+void I2CSim_SetPresent (unsigned char uc7Addr, int bPresent)
+{
+	I2CSim_Device * pDev = I2CSim_Find(uc7Addr);
+
+	if (pDev)
+		pDev->bPresent = bPresent ? 1 : 0;
+}
+
+// --------------------------------------------------------------------------
+// SSD1306 model
+// control byte after the address: bit 6 selects data (GDDRAM) or command,
+//  bit 7 (Co) means only one byte follows before the next control byte
+
+static unsigned char _SSD_RAM [8 * 128];
+static I2CSim_SSD1306_State _SSD;
+static unsigned char _SSD_bNeedCtrl;
+static unsigned char _SSD_bData;
+static unsigned char _SSD_bCo;
+static unsigned char _SSD_Cmd [8];
+static unsigned char _SSD_ucCmdLen;
+
+static void SSD_Reset (void)
+{
+	memset(_SSD_RAM, 0, sizeof(_SSD_RAM));
+	memset(&_SSD, 0, sizeof(_SSD));
+
+	// power-on: page addressing, full window
+	_SSD.ucAddrMode = 2;
+	_SSD.ucColEnd = 127;
+	_SSD.ucPageEnd = 7;
+	_SSD_ucCmdLen = 0;
+}
+
+// parameter bytes that follow each command
+static unsigned char SSD_Params (unsigned char ucCmd)
+{
+	switch (ucCmd)
+	{
+		case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+		case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+			return 1;
+		case 0x21: case 0x22: case 0xA3:
+			return 2;
+		case 0x29: case 0x2A:
+			return 5;
+		case 0x26: case 0x27:
+			return 6;
+		default:
+			return 0;
+	}
+}
+
+static void SSD_Exec (void)
+{
+	unsigned char ucCmd = _SSD_Cmd[0];
+
+	if (ucCmd <= 0x0F)
+		_SSD.ucCol = (_SSD.ucCol & 0xF0) | ucCmd;
+	else if (ucCmd <= 0x1F)
+		_SSD.ucCol = (_SSD.ucCol & 0x0F) | ((ucCmd & 0x0F) << 4);
+	else if (ucCmd >= 0xB0 && ucCmd <= 0xB7)
+		_SSD.ucPage = ucCmd & 0x07;
+	else switch (ucCmd)
+	{
+		case 0x20:
+			_SSD.ucAddrMode = _SSD_Cmd[1] & 0x03;
+			break;
+		case 0x21:
+			_SSD.ucColStart = _SSD_Cmd[1] & 0x7F;
+			_SSD.ucColEnd = _SSD_Cmd[2] & 0x7F;
+			_SSD.ucCol = _SSD.ucColStart;
+			break;
+		case 0x22:
+			_SSD.ucPageStart = _SSD_Cmd[1] & 0x07;
+			_SSD.ucPageEnd = _SSD_Cmd[2] & 0x07;
+			_SSD.ucPage = _SSD.ucPageStart;
+			break;
+		case 0x26:
+		case 0x27:
+			_SSD.ucScrollCmd = ucCmd;
+			_SSD.ucScrollStart = _SSD_Cmd[2] & 0x07;
+			_SSD.ucScrollEnd = _SSD_Cmd[4] & 0x07;
+			break;
+		case 0x29:
+		case 0x2A:
+			_SSD.ucScrollCmd = ucCmd;
+			_SSD.ucScrollStart = _SSD_Cmd[2] & 0x07;
+			_SSD.ucScrollEnd = _SSD_Cmd[4] & 0x07;
+			break;
+		case 0x2E:
+			_SSD.bScrolling = 0;
+			break;
+		case 0x2F:
+			_SSD.bScrolling = 1;
+			break;
+		case 0xAE:
+			_SSD.bDisplayOn = 0;
+			break;
+		case 0xAF:
+			_SSD.bDisplayOn = 1;
+			break;
+	}
+}
+
+static void SSD_Command (unsigned char ucData)
+{
+	++_SSD.ulCommandBytes;
+
+	_SSD_Cmd[_SSD_ucCmdLen++] = ucData;
+	if (_SSD_ucCmdLen > SSD_Params(_SSD_Cmd[0]))
+	{
+		SSD_Exec();
+		_SSD_ucCmdLen = 0;
+	}
+}
+
+static void SSD_Data (unsigned char ucData)
+{
+	++_SSD.ulDataBytes;
+	if (_SSD.bScrolling)
+		++_SSD.ulScrollWrites;
+
+	_SSD_RAM[_SSD.ucPage * 128 + _SSD.ucCol] = ucData;
+
+	switch (_SSD.ucAddrMode)
+	{
+		// horizontal: across the column window, then down a page
+		case 0:
+			if (_SSD.ucCol++ >= _SSD.ucColEnd)
+			{
+				_SSD.ucCol = _SSD.ucColStart;
+				if (_SSD.ucPage++ >= _SSD.ucPageEnd)
+					_SSD.ucPage = _SSD.ucPageStart;
+			}
+			break;
+
+		// vertical: down the page window, then across a column
+		case 1:
+			if (_SSD.ucPage++ >= _SSD.ucPageEnd)
+			{
+				_SSD.ucPage = _SSD.ucPageStart;
+				if (_SSD.ucCol++ >= _SSD.ucColEnd)
+					_SSD.ucCol = _SSD.ucColStart;
+			}
+			break;
+
+		// page: column wraps within the page
+		default:
+			_SSD.ucCol = (_SSD.ucCol + 1) & 0x7F;
+			break;
+	}
+}
+
+static void SSD_Start (int bRead)
+{
+	(void)bRead;
+	_SSD_bNeedCtrl = 1;
+}
+
+static int SSD_Write (unsigned char ucData)
+{
+	if (_SSD_bNeedCtrl)
+	{
+		_SSD_bNeedCtrl = 0;
+		_SSD_bData = (ucData & 0x40) != 0;
+		_SSD_bCo = (ucData & 0x80) != 0;
+		return 0;
+	}
+
+	if (_SSD_bData)
+		SSD_Data(ucData);
+	else
+		SSD_Command(ucData);
+
+	// Co set, the next byte is a control byte again
+	if (_SSD_bCo)
+		_SSD_bNeedCtrl = 1;
+
+	return 0;
+}
+
+// status read: bit 6 is display off
+static unsigned char SSD_Read (void)
+{
+	return _SSD.bDisplayOn ? 0x00 : 0x40;
+}
+
+static void SSD_Stop (void)
+{
+}
+
+const unsigned char * I2CSim_SSD1306_GDDRAM (void)
+{
+	return _SSD_RAM;
+}
+
+void I2CSim_SSD1306_GetState (I2CSim_SSD1306_State * pState)
+{
+	*pState = _SSD;
+}
+
+// --------------------------------------------------------------------------
+// VL53L1X model
+// 16-bit register index, auto-incrementing, big endian multi-byte values
+// measurements complete after a number of data ready polls (or on
+//  I2CSim_VL53L1X_Measure) and serve the next distance from the trace
+
+#define VL_REGS 0x0200
+
+static unsigned char _VL_Regs [VL_REGS];
+static unsigned int _VL_uiIndex;
+static unsigned char _VL_ucIndexBytes;
+static unsigned char _VL_bRanging;
+static unsigned char _VL_bReady;
+static unsigned int _VL_uiPollsLeft;
+static unsigned int _VL_uiReadyDelay;
+static const unsigned int * _VL_puiTrace;
+static unsigned int _VL_uiTraceCount;
+static unsigned int _VL_uiTracePos;
+static unsigned long _VL_ulSamples;
+static unsigned long _VL_ulPolls;
+
+static void VL_Reset (void)
+{
+	memset(_VL_Regs, 0, sizeof(_VL_Regs));
+	_VL_uiIndex = 0;
+	_VL_ucIndexBytes = 0;
+	_VL_bRanging = 0;
+	_VL_bReady = 0;
+	_VL_uiPollsLeft = 0;
+	_VL_uiTracePos = 0;
+	_VL_ulSamples = 0;
+	_VL_ulPolls = 0;
+
+	// booted, model id 0xEACC, oscillator calibration
+	_VL_Regs[0x00E5] = 0x03;
+	_VL_Regs[0x010F] = 0xEA;
+	_VL_Regs[0x0110] = 0xCC;
+	_VL_Regs[0x00DE] = 0x01;
+	_VL_Regs[0x00DF] = 0x5A;
+
+	// interrupt active high until configured
+	_VL_Regs[0x0030] = 0x01;
+}
+
+// data ready is bit 0 of GPIO__TIO_HV_STATUS, matching the polarity set
+//  in bit 4 of GPIO_HV_MUX__CTRL (0 there is active high)
+static unsigned char VL_ReadyLevel (void)
+{
+	unsigned char ucActiveHigh = !(_VL_Regs[0x0030] & 0x10);
+
+	return _VL_bReady ? ucActiveHigh : !ucActiveHigh;
+}
+
+static void VL_Put16 (unsigned int uiIndex, unsigned int uiValue)
+{
+	_VL_Regs[uiIndex] = (unsigned char)(uiValue >> 8);
+	_VL_Regs[uiIndex + 1] = (unsigned char)uiValue;
+}
+
+// measurement complete, load the result block
+static void VL_Sample (void)
+{
+	unsigned int uiDistance = 0;
+
+	if (_VL_uiTraceCount)
+	{
+		uiDistance = _VL_puiTrace[_VL_uiTracePos];
+		if (_VL_uiTracePos < _VL_uiTraceCount - 1)
+			++_VL_uiTracePos;
+	}
+
+	++_VL_ulSamples;
+	_VL_bReady = 1;
+
+	_VL_Regs[0x0089] = 0x09;                    // range valid
+	_VL_Regs[0x008A] = 0x00;
+	_VL_Regs[0x008B] = (unsigned char)_VL_ulSamples;  // stream count
+	VL_Put16(0x008C, 0x1000);                   // 16 effective SPADs (8.8)
+	VL_Put16(0x008E, 0x0100);                   // peak signal
+	VL_Put16(0x0090, 0x0010);                   // ambient
+	VL_Put16(0x0092, 0x0014);                   // sigma 5mm (14.2)
+	VL_Put16(0x0094, 0x0000);                   // phase
+	VL_Put16(0x0096, uiDistance);
+	VL_Put16(0x0098, 0x0100);                   // signal, crosstalk corrected
+}
+
+static void VL_WriteReg (unsigned int uiIndex, unsigned char ucValue)
+{
+	if (uiIndex >= VL_REGS)
+		return;
+
+	_VL_Regs[uiIndex] = ucValue;
+
+	switch (uiIndex)
+	{
+		// SYSTEM__INTERRUPT_CLEAR, arms the next measurement
+		case 0x0086:
+			if (ucValue & 0x01)
+			{
+				_VL_bReady = 0;
+				_VL_uiPollsLeft = _VL_uiReadyDelay;
+			}
+			break;
+
+		// SYSTEM__MODE_START
+		case 0x0087:
+			_VL_bRanging = (ucValue & 0x40) != 0;
+			_VL_uiPollsLeft = _VL_uiReadyDelay;
+			break;
+	}
+}
+
+static unsigned char VL_ReadReg (unsigned int uiIndex)
+{
+	if (uiIndex >= VL_REGS)
+		return 0;
+
+	// GPIO__TIO_HV_STATUS, each poll is a tick of the timing budget
+	if (uiIndex == 0x0031)
+	{
+		++_VL_ulPolls;
+		if (_VL_bRanging && !_VL_bReady)
+		{
+			if (!_VL_uiPollsLeft)
+				VL_Sample();
+			else
+				--_VL_uiPollsLeft;
+		}
+
+		return (_VL_Regs[0x0031] & 0xFE) | VL_ReadyLevel();
+	}
+
+	return _VL_Regs[uiIndex];
+}
+
+static void VL_Start (int bRead)
+{
+	// a write starts with a new index
+	if (!bRead)
+		_VL_ucIndexBytes = 0;
+}
+
+static int VL_Write (unsigned char ucData)
+{
+	if (_VL_ucIndexBytes < 2)
+	{
+		_VL_uiIndex = ((_VL_uiIndex << 8) | ucData) & 0xFFFF;
+		++_VL_ucIndexBytes;
+		return 0;
+	}
+
+	VL_WriteReg(_VL_uiIndex++, ucData);
+	return 0;
+}
+
+static unsigned char VL_Read (void)
+{
+	return VL_ReadReg(_VL_uiIndex++);
+}
+
+static void VL_Stop (void)
+{
+}
+
+void I2CSim_VL53L1X_SetTrace (const unsigned int * puiDistances, unsigned int uiCount)
+{
+	_VL_puiTrace = puiDistances;
+	_VL_uiTraceCount = uiCount;
+	_VL_uiTracePos = 0;
+}
+
+void I2CSim_VL53L1X_SetReadyDelay (unsigned int uiPolls)
+{
+	_VL_uiReadyDelay = uiPolls;
+}
+
+int I2CSim_VL53L1X_Measure (void)
+{
+	if (!_VL_bRanging || _VL_bReady)
+		return 0;
+
+	VL_Sample();
+	return 1;
+}
+
+int I2CSim_VL53L1X_GPIO1 (void)
+{
+	return VL_ReadyLevel();
+}
+
+unsigned char I2CSim_VL53L1X_GetReg (unsigned int uiIndex)
+{
+	return (uiIndex < VL_REGS) ? _VL_Regs[uiIndex] : 0;
+}
+
+void I2CSim_VL53L1X_SetReg (unsigned int uiIndex, unsigned char ucValue)
+{
+	if (uiIndex < VL_REGS)
+		_VL_Regs[uiIndex] = ucValue;
+}
+
+unsigned long I2CSim_VL53L1X_Samples (void)
+{
+	return _VL_ulSamples;
+}
+
+unsigned long I2CSim_VL53L1X_Polls (void)
+{
+	return _VL_ulPolls;
+}
+
+// --------------------------------------------------------------------------
+// LM75A model
+// pointer byte first, then register bytes high first
+// 0 temperature (2), 1 configuration (1), 2 hysteresis (2), 3 overtemp (2)
+
+static unsigned char _LM_Regs [4][2];
+static unsigned char _LM_ucPointer;
+static unsigned char _LM_bNeedPointer;
+static unsigned char _LM_ucByte;
+
+static void LM_Reset (void)
+{
+	memset(_LM_Regs, 0, sizeof(_LM_Regs));
+	_LM_Regs[2][0] = 75;    // 75C hysteresis
+	_LM_Regs[3][0] = 80;    // 80C overtemp
+	_LM_Regs[0][0] = 25;    // 25C
+	_LM_ucPointer = 0;
+}
+
+static void LM_Start (int bRead)
+{
+	_LM_ucByte = 0;
+	if (!bRead)
+		_LM_bNeedPointer = 1;
+}
+
+static int LM_Write (unsigned char ucData)
+{
+	if (_LM_bNeedPointer)
+	{
+		_LM_bNeedPointer = 0;
+		_LM_ucPointer = ucData & 0x03;
+		return 0;
+	}
+
+	// temperature register is read only
+	if (_LM_ucPointer)
+		_LM_Regs[_LM_ucPointer][_LM_ucByte++ & 1] = ucData;
+
+	return 0;
+}
+
+static unsigned char LM_Read (void)
+{
+	// configuration is a single byte, the others repeat every two
+	if (_LM_ucPointer == 1)
+		return _LM_Regs[1][0];
+
+	return _LM_Regs[_LM_ucPointer][_LM_ucByte++ & 1];
+}
+
+static void LM_Stop (void)
+{
+}
+
+void I2CSim_LM75A_SetTemp (unsigned int uiRaw)
+{
+	_LM_Regs[0][0] = (unsigned char)(uiRaw >> 8);
+	_LM_Regs[0][1] = (unsigned char)uiRaw;
+}
@@ -7,30 +7,15 @@
 
 int LM75A_ReadTemp (unsigned int * uiTemp)
 {
-	unsigned char ucDataH, ucDataL;
+	unsigned char ucData[2];
+	int iErr;
 
-	// start transaction with device address
-	if (I2C_Start(0x48, I2C_WRITE))
-	  return -1;
-	
-	// want to read temperature (register zero)
-	if (I2C_Write8(0, I2C_NOSTOP))
-	  return -2;
-	
-  // issue restart to change to read
-	if (I2C_Start(0x48, I2C_READ))
-	  return -3;
-
-  // read temperature data byte high, nostop, ack more data please
-	if (I2C_Read8(&ucDataH, I2C_ACK, I2C_NOSTOP))
-	  return -4;
-
-  // read temperature data byte low, stop, nack no more data please
-	if (I2C_Read8(&ucDataL, I2C_NACK, I2C_STOP))
-	  return -5;
+	// want to read temperature (register zero), high byte then low byte
+	if ((iErr = I2C_ReadRegs8(0x48, 0, ucData, 2)))
+	  return iErr;
 
   // form up the raw data into a 16-bit raw value for return
-	*uiTemp = ((unsigned int)ucDataH << 8) + ucDataL;
+	*uiTemp = ((unsigned int)ucData[0] << 8) + ucData[1];
 	
 	return 0;
 }
@@ -15,26 +15,49 @@
 #include "SSD1306.h"
 #include <avr/io.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 
 // the back-buffer for the OLED display
 // bits in here map to pixels on the display
 // no direct writes to display memory should occur
 // setting bits via functions will dirty flags for redraw
 #ifdef _SSD1306_DisplaySize128x64
+#define _SSD1306_PAGES 8
+#define _SSD1306_COM_PINS 0x12    // alternative COM pin config
 static unsigned char _DispBuff [8 * 128] = { 0 };
-
-// dirty flags for render management (vertical banks)
-static unsigned char _DispDirty [8] = { 0 };
 #endif
 
 #ifdef _SSD1306_DisplaySize128x32
+#define _SSD1306_PAGES 4
+#define _SSD1306_COM_PINS 0x02    // sequential COM pin config
 static unsigned char _DispBuff [4 * 128] = { 0 };
+#endif
+
+// dirty column span per page (vertical banks) for render management
+// first dirty column, and one past the last (0 when the page is clean)
+static unsigned char _DirtyFirst [_SSD1306_PAGES] = { 0 };
+static unsigned char _DirtyEnd [_SSD1306_PAGES] = { 0 };
 
-// dirty flags for render management (vertical banks)
-static unsigned char _DispDirty [4] = { 0 };
+#ifdef _SSD1306_SHADOW
+// what the panel holds, as of the last render
+static unsigned char _DispShadow [_SSD1306_PAGES * 128];
+
+// pages (bit per page) whose panel contents are unknown, as after power-up
+//  or a failed background render, these are sent whole rather than diffed
+static volatile unsigned char _ShadowStale = 0xFF;
 #endif
 
+// what it costs, in bus bytes, to split a render into one more window:
+//  the window command transaction (address, control, 6 bytes) and the
+//  address and control bytes of another data transaction
+#define _SSD1306_WINDOW_COST 10
+
+// rectangles one render may be split into, beyond this they are merged
+#define _SSD1306_WINDOWS 8
+
+// pages (bit per page) the panel is scrolling, renders hold while non-zero
+static unsigned char _ScrollPages = 0;
+
 // char map needs to cover characters ASCII 32 to 126, so 95 character mappings
 // functions will expect normal ASCII values, but map will offset correctly
 // 1 through 31 are special characters that need to be defined
@@ -143,143 +166,209 @@ const unsigned char _CharMap [96 * 5] PROGMEM =
   0x08, 0x04, 0x08, 0x10, 0x08	// 126 ~ +
 };
 
-#ifdef _SSD1306_DisplaySize128x64
-// are any flags for dirty set?
-int SSD1306_IsDirty (void)
+// large digits for the clock, 16 x 24 (3 pages), 7 x 11 designs drawn at
+//  twice the size with a 2 column gap on the right
+// stored a page at a time, 16 columns of page 0, then page 1, then page 2,
+//  so each page of a glyph is one memcpy_P into the back-buffer
+#define _SSD1306_BIG_WIDTH 16
+#define _SSD1306_BIG_COLON_WIDTH 8
+
+static const unsigned char _BigDigitMap [10 * 3 * _SSD1306_BIG_WIDTH] PROGMEM =
 {
-  for (int i = 0; i < 8; ++i)
-    if (_DispDirty[i])
-      return 1;
-  return 0;
+  // 0
+  0xF0, 0xF0, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00,
+  0x03, 0x03, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00,
+  // 1
+  0x00, 0x00, 0x30, 0x30, 0x0C, 0x0C, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x30, 0x30, 0x30, 0x30, 0x3F, 0x3F, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00,
+  // 2
+  0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0xC0, 0xC0, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00,
+  0x3C, 0x3C, 0x33, 0x33, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00,
+  // 3
+  0x00, 0x00, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x0C, 0x0C, 0x33, 0x33, 0xC0, 0xC0, 0x00, 0x00,
+  0x00, 0x00, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00,
+  // 4
+  0x00, 0x00, 0x00, 0x00, 0xC0, 0xC0, 0x30, 0x30, 0x0C, 0x0C, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+  0x3C, 0x3C, 0x33, 0x33, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0xFF, 0xFF, 0x30, 0x30, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00, 0x00, 0x00, 0x00,
+  // 5
+  0xFF, 0xFF, 0x03, 0x03, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0x03, 0x03, 0x03, 0x03, 0x00, 0x00,
+  0x03, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0xFC, 0xFC, 0x00, 0x00,
+  0x03, 0x03, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00,
+  // 6
+  0xF0, 0xF0, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0x00, 0x00, 0x00, 0x00,
+  0xFF, 0xFF, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0x03, 0x03, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00,
+  // 7
+  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0xF3, 0xF3, 0x0F, 0x0F, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0xF0, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  // 8
+  0x30, 0x30, 0xCC, 0xCC, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0xCC, 0xCC, 0x30, 0x30, 0x00, 0x00,
+  0xF0, 0xF0, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0x03, 0x03, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00,
+  // 9
+  0xF0, 0xF0, 0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x0C, 0x0C, 0xF0, 0xF0, 0x00, 0x00,
+  0x03, 0x03, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0xFF, 0xFF, 0x00, 0x00,
+  0x00, 0x00, 0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03, 0x00, 0x00
+};
+
+static const unsigned char _BigColonMap [3 * _SSD1306_BIG_COLON_WIDTH] PROGMEM =
+{
+  0x00, 0x00, 0xC0, 0xC0, 0xC0, 0xC0, 0x00, 0x00,
+  0x00, 0x00, 0xC3, 0xC3, 0xC3, 0xC3, 0x00, 0x00,
+  0x00, 0x00, 0x03, 0x03, 0x03, 0x03, 0x00, 0x00
+};
+
+// widen the dirty span of a page to cover columns iFirst to iLast
+static void SSD1306_Dirty (int iPage, int iFirst, int iLast)
+{
+  // keep to the panel, a span past column 127 would run the window off the
+  //  end of the page and the data would wrap into the next one
+  if (iFirst < 0)
+    iFirst = 0;
+  if (iLast > 127)
+    iLast = 127;
+  if (iFirst > iLast)
+    return;
+
+  if (!_DirtyEnd[iPage])
+  {
+    _DirtyFirst[iPage] = iFirst;
+    _DirtyEnd[iPage] = iLast + 1;
+    return;
+  }
+
+  if (iFirst < _DirtyFirst[iPage])
+    _DirtyFirst[iPage] = iFirst;
+  if (iLast >= _DirtyEnd[iPage])
+    _DirtyEnd[iPage] = iLast + 1;
 }
-#endif
 
-#ifdef _SSD1306_DisplaySize128x32
-// are any flags for dirty set?
+static int SSD1306_PageDirty (int iPage)
+{
+  return _DirtyEnd[iPage] != 0;
+}
+
+// every column of every page
+static void SSD1306_DirtyAll (void)
+{
+  for (int i = 0; i < _SSD1306_PAGES; ++i)
+  {
+    _DirtyFirst[i] = 0;
+    _DirtyEnd[i] = 128;
+  }
+}
+
+// are any pages dirty?
 int SSD1306_IsDirty (void)
 {
-  for (int i = 0; i < 4; ++i)
-    if (_DispDirty[i])
+  for (int i = 0; i < _SSD1306_PAGES; ++i)
+    if (SSD1306_PageDirty(i))
       return 1;
   return 0;
 }
+
+// a rectangle of the panel to send, pages and columns inclusive
+typedef struct
+{
+  unsigned char ucPageFirst;
+  unsigned char ucPageLast;
+  unsigned char ucColFirst;
+  unsigned char ucColLast;
+} SSD1306_Rect;
+
+// rectangles for the render being sent (foreground or background)
+static SSD1306_Rect _Plan [_SSD1306_WINDOWS];
+static unsigned char _PlanCount = 0;
+
+// render data comes from here, with the shadow this is the snapshot taken
+//  when the render was planned, so drawing can go on while it is sent
+#ifdef _SSD1306_SHADOW
+#define _SSD1306_SOURCE _DispShadow
+#else
+#define _SSD1306_SOURCE _DispBuff
 #endif
 
+#ifdef _SSD1306_SHADOW
+// background render state, advanced from the TWI interrupt by the
+//  completion callback of each transaction
+static I2C_Transaction _AsyncTrans;
+static unsigned char _AsyncCommands [6];
+static unsigned char _AsyncRect = 0;    // plan entry being sent
+static unsigned char _AsyncRow = 0;     // 0 for its window commands, then data rows from 1
+static volatile unsigned char _bAsyncBusy = 0;
+#endif
+
+// a background render owns the plan and the shadow, let it finish
+static void SSD1306_RenderWait (void)
+{
+#ifdef _SSD1306_SHADOW
+  while (_bAsyncBusy)
+    I2C_Wait(&_AsyncTrans);
+#endif
+}
+
+// the control byte (0x00 command, 0x40 data) is sent like a register index
 void SSD1306_Command8 (unsigned char command)
 {
-  // send device address, intent to write
-  if (I2C_Start(_SSD1306_ADDRESS, I2C_WRITE))
-    return;
-  
-  // write command, more data, so no stop
-  if (I2C_Write8(0x00, I2C_NOSTOP))
-    return;
-  
-  // write the command
-  if (I2C_Write8(command, I2C_STOP))
-    return;
+  SSD1306_RenderWait();
+  I2C_WriteRegs8(_SSD1306_ADDRESS, 0x00, &command, 1);
 }
 
 void SSD1306_Command16 (unsigned char commandA, unsigned char commandB)
 {
-  // send device address, intent to write
-  if (I2C_Start(_SSD1306_ADDRESS, I2C_WRITE))
-    return;
-  
-  // write command, more data, so no stop
-  if (I2C_Write8(0x00, I2C_NOSTOP))
-    return;
+  unsigned char commands [2] = { commandA, commandB };
   
-  // write the command
-  if (I2C_Write8(commandA, I2C_NOSTOP))
-    return;
-
-  // write the command
-  if (I2C_Write8(commandB, I2C_STOP))
-    return;
+  SSD1306_RenderWait();
+  I2C_WriteRegs8(_SSD1306_ADDRESS, 0x00, commands, 2);
 }
 
 void SSD1306_Data (unsigned char * data, unsigned int iCount)
 {
-  // send device address, intent to write
-  if (I2C_Start(_SSD1306_ADDRESS, I2C_WRITE))
-    return;
-
-  // write data, more data, so no stop
-  if (I2C_Write8(0x40, I2C_NOSTOP))
-    return;
-  
-  // do sequential writes, no stop until last byte
-  for (unsigned int i = 0; i < iCount - 1; ++i)
-  {
-    if (I2C_Write8(data[i], I2C_NOSTOP))
-      return;
-  }
-  
-  // last byte so issue stop
-  if (I2C_Write8(data[iCount - 1], I2C_STOP))
-    return;
+  SSD1306_RenderWait();
+  I2C_WriteRegs8(_SSD1306_ADDRESS, 0x40, data, iCount);
 }
 
-#ifdef _SSD1306_DisplaySize128x64
-void SSD1306_DispInit (void)
+// power-up command stream, sent as one transaction behind a single 0x00
+//  control byte rather than a transaction per command
+// the panel size only changes the multiplex ratio and COM pin config
+static const unsigned char _InitCommands [] PROGMEM =
 {
-  SSD1306_Command16 (0xA8, 0b10111111);   // set multiplex ratio P31 (default) (dim)
-  //SSD1306_Command16 (0xA8, 0b10001111);   // set multiplex ratio P31 (16)
-  
-  SSD1306_Command16 (0xD3, 0x00); // set display offset P31
-  SSD1306_Command8 (0x40);        // set display start line
-  SSD1306_Command8 (0xA0);        // set segment remap
-  SSD1306_Command8 (0xC0);        // set com output map direction
-  
-  SSD1306_Command16 (0xDA, 0b00010010); // set com pins hardware config (alternative) (default?)
-
-  SSD1306_Command16 (0x81, 0x7F); // set contrast (1/2 level)
-  SSD1306_Command8 (0xA4);        // display on, use RAM
-  SSD1306_Command8 (0xA6);        // set normal display (1 == pixel on)
-  
-  SSD1306_Command16 (0xD5, 0x80); // set display clock to defaults
-  SSD1306_Command16 (0x8D, 0x14); // this is critical, final pages (separate charge pump section)
-  
-  //SSD1306_Command16 (0xD9, 0b00100010); // pre-charge period (default)
-  //SSD1306_Command16 (0xD9, 0b01000100); // pre-charge period (double?) not sure if this changed much
-  
-  SSD1306_Command8 (0xAF);        // display on, normal mode
-  
-  SSD1306_Command16 (0x20, 0x02); // page mode
-  
-  SSD1306_Clear();                // ram will be scrambled eggs, so clear display
-}
-#endif
+  0xA8, _SSD1306_PAGES * 8 - 1, // set multiplex ratio, one per panel row
+  0xD3, 0x00,                   // set display offset
+  0x40,                         // set display start line
+  0xA0,                         // set segment remap
+  0xC0,                         // set com output map direction
+  0xDA, _SSD1306_COM_PINS,      // set com pins hardware config
+  0x81, 0x7F,                   // set contrast (1/2 level)
+  0xA4,                         // display on, use RAM
+  0xA6,                         // set normal display (1 == pixel on)
+  0xD5, 0x80,                   // set display clock to defaults
+  0x8D, 0x14,                   // this is critical, final pages (separate charge pump section)
+  //0xD9, 0b00100010,           // pre-charge period (default)
+  0xAF,                         // display on, normal mode
+  0x2E,                         // no scroll (it survives an MCU reset)
+  0x20, 0x00,                   // horizontal mode (Render sets the windows)
+  0x21, 0x00, 0x7F              // column window 0-127
+};
 
-#ifdef _SSD1306_DisplaySize128x32
 void SSD1306_DispInit (void)
 {
-  SSD1306_Command16 (0xA8, 0x1F);   // set multiplex ratio P31 (default) (dim)
-  
-  SSD1306_Command16 (0xD3, 0x00); // set display offset P31
-  SSD1306_Command8 (0x40);        // set display start line
-  SSD1306_Command8 (0xA0);        // set segment remap
-  SSD1306_Command8 (0xC0);        // set com output map direction
-  
-  SSD1306_Command16 (0xDA, 0x02); // set com pins hardware config (alternative) (default?)
-
-  SSD1306_Command16 (0x81, 0x7F); // set contrast (1/2 level)
-  SSD1306_Command8 (0xA4);        // display on, use RAM
-  SSD1306_Command8 (0xA6);        // set normal display (1 == pixel on)
-  
-  SSD1306_Command16 (0xD5, 0x80); // set display clock to defaults
-  SSD1306_Command16 (0x8D, 0x14); // this is critical, final pages (separate charge pump section)
-  
-  SSD1306_Command8 (0xAF);        // display on, normal mode
-  
-  SSD1306_Command16 (0x20, 0x02); // page mode
+  SSD1306_RenderWait();
+  I2C_WriteRegs8_P(_SSD1306_ADDRESS, 0x00, _InitCommands, sizeof(_InitCommands));
+  _ScrollPages = 0;
   
+#ifdef _SSD1306_SHADOW
+  _ShadowStale = 0xFF;            // panel ram unknown, nothing to diff against
+#endif
   SSD1306_Clear();                // ram will be scrambled eggs, so clear display
 }
-#endif
 
-// no charge pump change (yet)
 void SSD1306_DisplayOn (void)
 {
   SSD1306_Command8 (0xAF);        // display on, normal mode
@@ -291,6 +380,100 @@ void SSD1306_DisplayOff (void)
   SSD1306_Command8 (0xAE);        // display sleep
 }
 
+// several commands (with their parameters) in one transaction
+static void SSD1306_Commands (const unsigned char * pCommands, unsigned int uiCount)
+{
+  SSD1306_RenderWait();
+  I2C_WriteRegs8(_SSD1306_ADDRESS, 0x00, pCommands, uiCount);
+}
+
+// hardware scrolling
+// the panel moves its own RAM, so the back-buffer no longer matches it:
+//  while a scroll runs, renders hold (drawing still goes to the back-buffer
+//  and stays dirty), and stopping marks the scrolled pages for a full resend
+void SSD1306_ScrollH (int bLeft, unsigned char ucPageStart, unsigned char ucPageEnd, unsigned char ucInterval)
+{
+  unsigned char commands [8] =
+  {
+    bLeft ? 0x27 : 0x26,
+    0x00,                         // dummy
+    ucPageStart,
+    ucInterval & 0x07,
+    ucPageEnd,
+    0x00, 0xFF,                   // dummies
+    0x2F                          // activate
+  };
+
+  if (ucPageEnd >= _SSD1306_PAGES || ucPageStart > ucPageEnd)
+    return;
+
+  // the datasheet wants the scroll off while it is set up, and the panel
+  //  has to be showing the back-buffer before it starts moving it
+  SSD1306_ScrollStop();
+  SSD1306_Render();
+
+  SSD1306_Commands(commands, sizeof(commands));
+  _ScrollPages = (0xFF >> (7 - ucPageEnd)) & (0xFF << ucPageStart);
+}
+
+// horizontal scroll of the page range plus a vertical scroll of the whole
+//  display by ucRowOffset rows per step
+void SSD1306_ScrollDiag (int bLeft, unsigned char ucPageStart, unsigned char ucPageEnd, unsigned char ucInterval, unsigned char ucRowOffset)
+{
+  unsigned char commands [10] =
+  {
+    0xA3, 0x00, _SSD1306_PAGES * 8, // vertical scroll area, all rows
+    bLeft ? 0x2A : 0x29,
+    0x00,                         // dummy
+    ucPageStart,
+    ucInterval & 0x07,
+    ucPageEnd,
+    ucRowOffset,
+    0x2F                          // activate
+  };
+
+  if (ucPageEnd >= _SSD1306_PAGES || ucPageStart > ucPageEnd)
+    return;
+
+  SSD1306_ScrollStop();
+  SSD1306_Render();
+
+  SSD1306_Commands(commands, sizeof(commands));
+
+  // the vertical part moves every page
+  _ScrollPages = 0xFF;
+}
+
+void SSD1306_ScrollStop (void)
+{
+  // deactivate, and put the start line the vertical scroll moved back
+  static const unsigned char commands [2] = { 0x2E, 0x40 };
+
+  if (!_ScrollPages)
+    return;
+
+  SSD1306_Commands(commands, sizeof(commands));
+
+  // RAM of the scrolled pages was moved, resend it whole
+  for (int i = 0; i < _SSD1306_PAGES; ++i)
+  {
+    if (_ScrollPages & (1 << i))
+    {
+#ifdef _SSD1306_SHADOW
+      _ShadowStale |= 1 << i;
+#endif
+      SSD1306_Dirty(i, 0, 127);
+    }
+  }
+  _ScrollPages = 0;
+}
+
+// non-zero while a hardware scroll is running
+int SSD1306_Scrolling (void)
+{
+  return _ScrollPages != 0;
+}
+
 #ifdef _SSD1306_DisplaySize128x64
 // fill in ram with random junk
 void SSD1306_Noise (void)
@@ -298,8 +481,7 @@ void SSD1306_Noise (void)
   for (int i = 0; i < 1024; ++i)
     _DispBuff[i] = rand() % 256;
   
-  for (int i = 0; i < 8; ++i)
-    _DispDirty [i] = 1;
+  SSD1306_DirtyAll();
   
   SSD1306_Render();
 }
@@ -312,8 +494,7 @@ void SSD1306_Noise (void)
   for (int i = 0; i < 512; ++i)
     _DispBuff[i] = rand() % 256;
   
-  for (int i = 0; i < 4; ++i)
-    _DispDirty [i] = 1;
+  SSD1306_DirtyAll();
   
   SSD1306_Render();
 }
@@ -325,8 +506,7 @@ void SSD1306_Clear (void)
   for (int i = 0; i < 1024; ++i)
     _DispBuff[i] = 0;
 
-  for (int i = 0; i < 8; ++i)
-    _DispDirty [i] = 1;
+  SSD1306_DirtyAll();
 
   SSD1306_Render ();
 }
@@ -338,64 +518,381 @@ void SSD1306_Clear (void)
   for (int i = 0; i < 512; ++i)
     _DispBuff[i] = 0;
 
-  for (int i = 0; i < 4; ++i)
-    _DispDirty [i] = 1;
+  SSD1306_DirtyAll();
 
   SSD1306_Render ();
 }
 #endif
 
-#ifdef _SSD1306_DisplaySize128x64
-void SSD1306_Render (void)
+// clear the back-buffer for a new frame, the panel is left alone until
+//  SSD1306_EndFrame
+// only columns that held something are cleared and marked dirty, so a
+//  frame that redraws the same pixels stays a small update
+void SSD1306_BeginFrame (void)
+{
+  for (int iPage = 0; iPage < _SSD1306_PAGES; ++iPage)
+  {
+    unsigned char * pPage = _DispBuff + iPage * 128;
+
+    int iFirst = 0;
+    while (iFirst < 128 && !pPage[iFirst])
+      ++iFirst;
+    if (iFirst == 128)
+      continue;
+
+    int iEnd = 128;
+    while (!pPage[iEnd - 1])
+      --iEnd;
+
+    memset(pPage + iFirst, 0, iEnd - iFirst);
+    SSD1306_Dirty(iPage, iFirst, iEnd - 1);
+  }
+}
+
+// send the frame drawn since SSD1306_BeginFrame
+void SSD1306_EndFrame (void)
+{
+  SSD1306_Render();
+}
+
+// add a rectangle to the plan
+// once the plan is full, further rectangles are merged into the last one
+//  (more bytes, but anything inside a rectangle is safe to resend)
+static void SSD1306_PlanAdd (int iPageFirst, int iPageLast, int iColFirst, int iColLast)
 {
-  // ensure we are at column 0 before bank output starts
-  SSD1306_Command8 (0x00);    // col 0
-  SSD1306_Command8 (0x10);    // col 0
+  SSD1306_Rect * pRect;
 
-  // render each page, as necessary
-  for (int i = 0; i < 8; ++i)
+  if (_PlanCount < _SSD1306_WINDOWS)
   {
-    // only update this area if dirty
-    if (_DispDirty[i])
+    pRect = &_Plan[_PlanCount++];
+    pRect->ucPageFirst = iPageFirst;
+    pRect->ucPageLast = iPageLast;
+    pRect->ucColFirst = iColFirst;
+    pRect->ucColLast = iColLast;
+    return;
+  }
+
+  pRect = &_Plan[_PlanCount - 1];
+  pRect->ucPageLast = iPageLast;
+  if (iColFirst < pRect->ucColFirst)
+    pRect->ucColFirst = iColFirst;
+  if (iColLast > pRect->ucColLast)
+    pRect->ucColLast = iColLast;
+}
+
+// data transactions a rectangle takes: one when it spans whole pages, as
+//  the panel wraps to the next page by itself, otherwise one per page (a
+//  narrower window is not contiguous in the buffer, but the panel keeps
+//  its place between transactions)
+static int SSD1306_RectRows (const SSD1306_Rect * pRect)
+{
+  if (pRect->ucColFirst == 0 && pRect->ucColLast == 127)
+    return 1;
+  return pRect->ucPageLast - pRect->ucPageFirst + 1;
+}
+
+// window commands for a rectangle
+static void SSD1306_RectCommands (const SSD1306_Rect * pRect, unsigned char * pCommands)
+{
+  pCommands[0] = 0x21;
+  pCommands[1] = pRect->ucColFirst;
+  pCommands[2] = pRect->ucColLast;
+  pCommands[3] = 0x22;
+  pCommands[4] = pRect->ucPageFirst;
+  pCommands[5] = pRect->ucPageLast;
+}
+
+// data for one row (see SSD1306_RectRows) of a rectangle
+static unsigned char * SSD1306_RectRow (const SSD1306_Rect * pRect, int iRow, unsigned int * puiCount)
+{
+  if (SSD1306_RectRows(pRect) == 1)
+    *puiCount = (pRect->ucPageLast - pRect->ucPageFirst + 1) * (pRect->ucColLast - pRect->ucColFirst + 1);
+  else
+    *puiCount = pRect->ucColLast - pRect->ucColFirst + 1;
+
+  return _SSD1306_SOURCE + (pRect->ucPageFirst + iRow) * 128 + pRect->ucColFirst;
+}
+
+#ifdef _SSD1306_SHADOW
+// narrow a page's dirty span to the bytes that differ from the panel
+//  (the page is clean if none do)
+static void SSD1306_Diff (int iPage)
+{
+  // panel contents unknown, the whole page has to go
+  if (_ShadowStale & (1 << iPage))
+  {
+    _DirtyFirst[iPage] = 0;
+    _DirtyEnd[iPage] = 128;
+    return;
+  }
+
+  if (!_DirtyEnd[iPage])
+    return;
+
+  unsigned char * pBuff = _DispBuff + iPage * 128;
+  unsigned char * pShadow = _DispShadow + iPage * 128;
+  int iFirst = _DirtyFirst[iPage];
+  int iEnd = _DirtyEnd[iPage];
+
+  while (iFirst < iEnd && pBuff[iFirst] == pShadow[iFirst])
+    ++iFirst;
+  while (iEnd > iFirst && pBuff[iEnd - 1] == pShadow[iEnd - 1])
+    --iEnd;
+
+  _DirtyFirst[iPage] = iFirst;
+  _DirtyEnd[iPage] = (iFirst < iEnd) ? iEnd : 0;
+}
+#endif
+
+// plan one page's dirty span
+// with the shadow, a stretch of unchanged bytes longer than a window costs
+//  splits it into separate windows
+static void SSD1306_PlanSpan (int iPage)
+{
+#ifdef _SSD1306_SHADOW
+  if (!(_ShadowStale & (1 << iPage)))
+  {
+    unsigned char * pBuff = _DispBuff + iPage * 128;
+    unsigned char * pShadow = _DispShadow + iPage * 128;
+    int iEnd = _DirtyEnd[iPage];
+    int i = _DirtyFirst[iPage];
+
+    while (i < iEnd)
     {
-      // mark as clean and render
-      _DispDirty[i] = 0;
-      SSD1306_Command8 (0xB0 + i);  // set bank
-      SSD1306_Data(_DispBuff + i * 128, 128); // dump bank
+      // i differs, the run goes on until too many bytes in a row match
+      int iRunEnd = i + 1;
+      int iSame = 0;
+      for (int j = i + 1; j < iEnd && iSame <= _SSD1306_WINDOW_COST; ++j)
+      {
+        if (pBuff[j] == pShadow[j])
+          ++iSame;
+        else
+        {
+          iSame = 0;
+          iRunEnd = j + 1;
+        }
+      }
+
+      SSD1306_PlanAdd(iPage, iPage, i, iRunEnd - 1);
+
+      // on to the next byte that differs
+      i = iRunEnd;
+      while (i < iEnd && pBuff[i] == pShadow[i])
+        ++i;
     }
+    return;
   }
+#endif
+
+  SSD1306_PlanAdd(iPage, iPage, _DirtyFirst[iPage], _DirtyEnd[iPage] - 1);
 }
+
+// work out what the next render sends, and mark it clean
+// the panel is in horizontal addressing mode (see DispInit), so after the
+//  column and page windows are set the RAM pointer walks across the window
+//  and wraps to the next page by itself
+// each run of adjacent dirty pages goes out either as one rectangle covering
+//  all their dirty spans, or as each page's own span, whichever is fewer
+//  bytes on the bus (a full frame is a single data transaction, one changed
+//  glyph is a few bytes)
+// with the shadow, spans are first narrowed to the bytes that changed, so
+//  redrawing the same frame sends nothing, and the changes are copied into
+//  the shadow, which is what gets sent
+static void SSD1306_Plan (void)
+{
+  int i = 0;
+
+  _PlanCount = 0;
+
+  // the panel is moving its RAM, writes would land in the wrong place
+  //  (the dirty spans wait for SSD1306_ScrollStop)
+  if (_ScrollPages)
+    return;
+
+#ifdef _SSD1306_SHADOW
+  for (int iPage = 0; iPage < _SSD1306_PAGES; ++iPage)
+    SSD1306_Diff(iPage);
 #endif
 
-#ifdef _SSD1306_DisplaySize128x32
+  while (i < _SSD1306_PAGES)
+  {
+    // find the next run of dirty pages
+    if (!SSD1306_PageDirty(i))
+    {
+      ++i;
+      continue;
+    }
+
+    int iFirst = i;
+    int iColFirst = 127;
+    int iColEnd = 0;
+    int iSplitCost = 0;
+    while (i < _SSD1306_PAGES && SSD1306_PageDirty(i))
+    {
+      if (_DirtyFirst[i] < iColFirst)
+        iColFirst = _DirtyFirst[i];
+      if (_DirtyEnd[i] > iColEnd)
+        iColEnd = _DirtyEnd[i];
+      iSplitCost += _DirtyEnd[i] - _DirtyFirst[i] + _SSD1306_WINDOW_COST;
+      ++i;
+    }
+
+    // a rectangle narrower than a page is sent a page at a time anyway
+    int iRectWidth = iColEnd - iColFirst;
+    int iRectCost = iRectWidth * (i - iFirst) + _SSD1306_WINDOW_COST;
+    if (iRectWidth < 128)
+      iRectCost += (i - iFirst - 1) * 2;
+
+    if (iRectCost <= iSplitCost)
+      SSD1306_PlanAdd(iFirst, i - 1, iColFirst, iColEnd - 1);
+    else
+    {
+      for (int iPage = iFirst; iPage < i; ++iPage)
+        SSD1306_PlanSpan(iPage);
+    }
+
+    // mark as clean, it is in the plan
+    for (int iPage = iFirst; iPage < i; ++iPage)
+    {
+#ifdef _SSD1306_SHADOW
+      // the panel will match the back-buffer over the span (and outside
+      //  it already did)
+      memcpy(_DispShadow + iPage * 128 + _DirtyFirst[iPage], _DispBuff + iPage * 128 + _DirtyFirst[iPage],
+        _DirtyEnd[iPage] - _DirtyFirst[iPage]);
+      _ShadowStale &= ~(1 << iPage);
+#endif
+      _DirtyEnd[iPage] = 0;
+    }
+  }
+}
+
 void SSD1306_Render (void)
 {
-  // ensure we are at column 0 before bank output starts
-  SSD1306_Command8 (0x00);    // col 0
-  SSD1306_Command8 (0x10);    // col 0
+  unsigned char commands [6];
+  unsigned int uiCount;
+
+  SSD1306_RenderWait();
+  SSD1306_Plan();
+
+  for (int i = 0; i < _PlanCount; ++i)
+  {
+    SSD1306_RectCommands(&_Plan[i], commands);
+    I2C_WriteRegs8(_SSD1306_ADDRESS, 0x00, commands, 6);
+
+    for (int iRow = 0; iRow < SSD1306_RectRows(&_Plan[i]); ++iRow)
+    {
+      unsigned char * pData = SSD1306_RectRow(&_Plan[i], iRow, &uiCount);
+      I2C_WriteRegs8(_SSD1306_ADDRESS, 0x40, pData, uiCount);
+    }
+  }
+
+  _PlanCount = 0;
+}
+
+#ifdef _SSD1306_SHADOW
+static void SSD1306_AsyncDone (I2C_Transaction * pTrans);
+
+// put the current step of the background render on the bus
+static void SSD1306_AsyncSubmit (void)
+{
+  SSD1306_Rect * pRect = &_Plan[_AsyncRect];
+
+  if (!_AsyncRow)
+  {
+    SSD1306_RectCommands(pRect, _AsyncCommands);
+    _AsyncTrans.ucHeader[0] = 0x00;
+    _AsyncTrans.pWrite = _AsyncCommands;
+    _AsyncTrans.uiWriteCount = 6;
+  }
+  else
+  {
+    _AsyncTrans.ucHeader[0] = 0x40;
+    _AsyncTrans.pWrite = SSD1306_RectRow(pRect, _AsyncRow - 1, &_AsyncTrans.uiWriteCount);
+  }
+
+  // queue full, can't go on
+  if (I2C_Submit(&_AsyncTrans))
+  {
+    _AsyncTrans.iStatus = -1;
+    SSD1306_AsyncDone(&_AsyncTrans);
+  }
+}
+
+// completion callback, runs from the TWI interrupt
+static void SSD1306_AsyncDone (I2C_Transaction * pTrans)
+{
+  if (pTrans->iStatus)
+  {
+    // the panel contents are unknown from here on, so the pages the
+    //  render had not finished are resent whole by the next one
+    for (int i = _AsyncRect; i < _PlanCount; ++i)
+      for (int iPage = _Plan[i].ucPageFirst; iPage <= _Plan[i].ucPageLast; ++iPage)
+        _ShadowStale |= 1 << iPage;
+
+    _bAsyncBusy = 0;
+    return;
+  }
 
-  // render each page, as necessary
-  for (int i = 0; i < 4; ++i)
+  // next row of this rectangle, or the next rectangle
+  if (++_AsyncRow > SSD1306_RectRows(&_Plan[_AsyncRect]))
   {
-    // only update this area if dirty
-    if (_DispDirty[i])
+    _AsyncRow = 0;
+    if (++_AsyncRect >= _PlanCount)
     {
-      // mark as clean and render
-      _DispDirty[i] = 0;
-      SSD1306_Command8 (0xB0 + i);  // set bank
-      SSD1306_Data(_DispBuff + i * 128, 128); // dump bank
+      _bAsyncBusy = 0;
+      return;
     }
   }
+
+  SSD1306_AsyncSubmit();
 }
 #endif
 
+// plan and snapshot the frame, then send it from the TWI interrupt a
+//  transaction at a time while the caller carries on
+// drawing calls are safe while it runs, they go into the next frame
+// without _SSD1306_SHADOW there is nothing to send a snapshot from, so this
+//  is the same as SSD1306_Render
+void SSD1306_RenderAsync (void)
+{
+#ifdef _SSD1306_SHADOW
+  SSD1306_RenderWait();
+  SSD1306_Plan();
+  if (!_PlanCount)
+    return;
+
+  _AsyncTrans.uc7Addr = _SSD1306_ADDRESS;
+  _AsyncTrans.ucHeaderCount = 1;
+  _AsyncTrans.pRead = 0;
+  _AsyncTrans.uiReadCount = 0;
+  _AsyncTrans.pCallback = SSD1306_AsyncDone;
+
+  _AsyncRect = 0;
+  _AsyncRow = 0;
+  _bAsyncBusy = 1;
+  SSD1306_AsyncSubmit();
+#else
+  SSD1306_Render();
+#endif
+}
+
+// non-zero while a background render is still being sent
+int SSD1306_RenderBusy (void)
+{
+#ifdef _SSD1306_SHADOW
+  return _bAsyncBusy;
+#else
+  return 0;
+#endif
+}
+
 #ifdef _SSD1306_DisplaySize128x64
 void SSD1306_SetPage (int page, PGM_P buff)
 {
     if (page < 0 || page > 7)
       return;
     
-    _DispDirty[page] = 1;
+    SSD1306_Dirty(page, 0, 127);
     
     // copy out of flash to local display buffer
     memcpy_P (_DispBuff + page * 128, buff, 128);
@@ -408,10 +905,10 @@ void SSD1306_SetPage (int page, PGM_P buff)
 #ifdef _SSD1306_DisplaySize128x32
 void SSD1306_SetPage (int page, PGM_P buff)
 {
-    if (page < 0 || page > 4)
+    if (page < 0 || page > 3)
       return;
     
-    _DispDirty[page] = 1;
+    SSD1306_Dirty(page, 0, 127);
     
     // copy out of flash to local display buffer
     memcpy_P (_DispBuff + page * 128, buff, 128);
@@ -421,6 +918,61 @@ void SSD1306_SetPage (int page, PGM_P buff)
 }
 #endif
 
+// draw an RLE bitmap from flash (see tools/rle_encode.py) with its top left
+//  at column iX of page iPage, replacing what was there
+// decoded straight into the back-buffer, parts off the display are
+//  skipped, and only the columns drawn are marked dirty
+// asset: width, pages, then packets of 0x80 | (n - 1), byte (a run of n)
+//  or n - 1, n bytes (literal), or with 0x80 set in pages (stored) the
+//  page bytes as they are
+void SSD1306_BlitRLE (int iX, int iPage, PGM_P pAsset)
+{
+  int iWidth = pgm_read_byte(pAsset++);
+  int iPages = pgm_read_byte(pAsset++);
+  unsigned char bStored = iPages & 0x80;
+  int iCol = 0;
+  int iRow = 0;
+
+  iPages &= 0x7F;
+
+  while (iRow < iPages)
+  {
+    // a stored bitmap is one literal the size of the whole thing
+    unsigned char ucCode = bStored ? 0 : pgm_read_byte(pAsset++);
+    unsigned char ucByte = 0;
+    int iCount = bStored ? iWidth * iPages : (ucCode & 0x7F) + 1;
+
+    if (ucCode & 0x80)
+      ucByte = pgm_read_byte(pAsset++);
+
+    while (iCount-- && iRow < iPages)
+    {
+      if (!(ucCode & 0x80))
+        ucByte = pgm_read_byte(pAsset++);
+
+      int iDestX = iX + iCol;
+      int iDestPage = iPage + iRow;
+      if (iDestX >= 0 && iDestX < 128 && iDestPage >= 0 && iDestPage < _SSD1306_PAGES)
+        _DispBuff[iDestPage * 128 + iDestX] = ucByte;
+
+      if (++iCol >= iWidth)
+      {
+        iCol = 0;
+        ++iRow;
+      }
+    }
+  }
+
+  // dirty the part that landed on the display
+  int iFirst = (iX < 0) ? 0 : iX;
+  int iLast = (iX + iWidth > 128) ? 127 : iX + iWidth - 1;
+  if (iFirst > iLast)
+    return;
+
+  for (int i = (iPage < 0) ? 0 : iPage; i < iPage + iPages && i < _SSD1306_PAGES; ++i)
+    SSD1306_Dirty(i, iFirst, iLast);
+}
+
 #ifdef _SSD1306_DisplaySize128x64
 void SSD1306_SetPixel (int iX, int iY)
 {
@@ -435,8 +987,8 @@ void SSD1306_SetPixel (int iX, int iY)
   int iByte = iX + (iY / 8) * 128;
   _DispBuff[iByte] |= 1 << (iY % 8);
   
-  // mark affected bank as dirty
-  _DispDirty[iY/8] = 1;
+  // mark affected column of the bank as dirty
+  SSD1306_Dirty(iY / 8, iX, iX);
 }
 #endif
 
@@ -454,8 +1006,8 @@ void SSD1306_SetPixel (int iX, int iY)
   int iByte = iX + (iY / 8) * 128;
   _DispBuff[iByte] |= 1 << (iY % 8);
   
-  // mark affected bank as dirty
-  _DispDirty[iY/8] = 1;
+  // mark affected column of the bank as dirty
+  SSD1306_Dirty(iY / 8, iX, iX);
 }
 #endif
 
@@ -479,11 +1031,38 @@ void SSD1306_Order (int *iA, int *iB)
   *iB = temp;
 }
 
-void SSD1306_Circle (int iXS, int iYS, float fRad)
+// midpoint circle, integer only
+// walks one octant from the top of the circle and mirrors it into the
+//  other seven, iErr tracks which side of the true circle the midpoint
+//  between the two candidate pixels is on
+void SSD1306_Circle (int iXS, int iYS, int iRad)
 {
-  for (float fAng = 0; fAng <= 2 * M_PI; fAng += 0.025f)
+  if (iRad < 0)
+    return;
+
+  int iX = iRad;
+  int iY = 0;
+  int iErr = 1 - iRad;
+
+  while (iX >= iY)
   {
-    SSD1306_SetPixel((int)(cos(fAng) * fRad + iXS), (int)(sin (fAng) * fRad + iYS));
+    SSD1306_SetPixel(iXS + iX, iYS + iY);
+    SSD1306_SetPixel(iXS + iY, iYS + iX);
+    SSD1306_SetPixel(iXS - iY, iYS + iX);
+    SSD1306_SetPixel(iXS - iX, iYS + iY);
+    SSD1306_SetPixel(iXS - iX, iYS - iY);
+    SSD1306_SetPixel(iXS - iY, iYS - iX);
+    SSD1306_SetPixel(iXS + iY, iYS - iX);
+    SSD1306_SetPixel(iXS + iX, iYS - iY);
+
+    ++iY;
+    if (iErr < 0)
+      iErr += 2 * iY + 1;
+    else
+    {
+      --iX;
+      iErr += 2 * (iY - iX) + 1;
+    }
   }
 }
 
@@ -493,34 +1072,132 @@ void SSD1306_Line (int iXS, int iYS, int iXE, int iYE)
   if (iXS < 0 || iXS > 127 || iYS < 0 || iYS > 63 || iXE < 0 || iXE > 127 || iYE < 0 || iYE > 63)
     return;
   
-  // now step through the larger of the two axes displacements and move in 1/2 steps
-  int iXDisp = abs (iXE - iXS);
-  int iYDisp = abs (iYE - iYS);
+  // Bresenham, integer only: iErr is the running error of both axes
+  //  (scaled by 2 to stay whole), each pixel steps whichever axes keep the
+  //  line closest to the true one, end points included
+  int iDX = abs(iXE - iXS);
+  int iDY = -abs(iYE - iYS);
+  int iSX = (iXS < iXE) ? 1 : -1;
+  int iSY = (iYS < iYE) ? 1 : -1;
+  int iErr = iDX + iDY;
 
-  int Steps = SSD1306_Max(iXDisp, iYDisp);
-  if (!Steps)
+  while (1)
   {
-    // this is a single pixel line
     SSD1306_SetPixel(iXS, iYS);
-    return;
+    if (iXS == iXE && iYS == iYE)
+      break;
+
+    int iErr2 = 2 * iErr;
+    if (iErr2 >= iDY)
+    {
+      iErr += iDY;
+      iXS += iSX;
+    }
+    if (iErr2 <= iDX)
+    {
+      iErr += iDX;
+      iYS += iSY;
+    }
   }
-  
-  // this is not a single pixel line, but it could be horizontal or vertical
-  float fXStep = (iXE - iXS) / (float)Steps;
-  float fYStep = (iYE - iYS) / (float)Steps;
-  
-  // go through the steps, increasing the axes steps and filling pixels
-  float fXPos = iXS;
-  float fYPos = iYS;
-  
-  // todo: modify for oversampling (2x?)
-  for (int i = 0; i < Steps; ++i)
+}
+
+// set (or clear) the bits of ucMask in columns iXS to iXE of a page
+static void SSD1306_Span (int iPage, int iXS, int iXE, unsigned char ucMask, int bSet)
+{
+  unsigned char * pByte = _DispBuff + iPage * 128 + iXS;
+  unsigned char * pEnd = pByte + (iXE - iXS) + 1;
+
+  if (bSet)
   {
-    SSD1306_SetPixel((int)fXPos, (int)fYPos);
-    
-    fXPos += fXStep;
-    fYPos += fYStep;
+    while (pByte < pEnd)
+      *pByte++ |= ucMask;
+  }
+  else
+  {
+    ucMask = ~ucMask;
+    while (pByte < pEnd)
+      *pByte++ &= ucMask;
   }
+
+  SSD1306_Dirty(iPage, iXS, iXE);
+}
+
+// set (or clear) the pixels of a rectangle, corners inclusive, clipped to
+//  the display
+// each page the rectangle touches is one masked span: full bytes in the
+//  middle pages, partial masks for the top and bottom edges
+static void SSD1306_Area (int iXS, int iYS, int iXE, int iYE, int bSet)
+{
+  if (iXS < 0)
+    iXS = 0;
+  if (iXE > 127)
+    iXE = 127;
+  if (iYS < 0)
+    iYS = 0;
+  if (iYE > _SSD1306_PAGES * 8 - 1)
+    iYE = _SSD1306_PAGES * 8 - 1;
+  if (iXS > iXE || iYS > iYE)
+    return;
+
+  for (int iPage = iYS / 8; iPage <= iYE / 8; ++iPage)
+  {
+    unsigned char ucMask = 0xFF;
+    if (iPage == iYS / 8)
+      ucMask &= 0xFF << (iYS % 8);
+    if (iPage == iYE / 8)
+      ucMask &= 0xFF >> (7 - iYE % 8);
+
+    SSD1306_Span(iPage, iXS, iXE, ucMask, bSet);
+  }
+}
+
+void SSD1306_FillRect (int iX, int iY, int iWidth, int iHeight)
+{
+  if (iWidth > 0 && iHeight > 0)
+    SSD1306_Area(iX, iY, iX + iWidth - 1, iY + iHeight - 1, 1);
+}
+
+void SSD1306_ClearRect (int iX, int iY, int iWidth, int iHeight)
+{
+  if (iWidth > 0 && iHeight > 0)
+    SSD1306_Area(iX, iY, iX + iWidth - 1, iY + iHeight - 1, 0);
+}
+
+void SSD1306_HLine (int iX, int iY, int iWidth)
+{
+  SSD1306_FillRect(iX, iY, iWidth, 1);
+}
+
+void SSD1306_VLine (int iX, int iY, int iHeight)
+{
+  SSD1306_FillRect(iX, iY, 1, iHeight);
+}
+
+// outlined bar filled uiValue / uiMax of the way from the left, with a one
+//  pixel gap inside the outline
+// the whole bar is drawn, filled and empty part, so it can be redrawn over
+//  itself without clearing first
+void SSD1306_ProgressBar (int iX, int iY, int iWidth, int iHeight, unsigned int uiValue, unsigned int uiMax)
+{
+  // too small for the outline and gap
+  if (iWidth < 5 || iHeight < 5)
+    return;
+
+  if (uiValue > uiMax)
+    uiValue = uiMax;
+
+  // outline
+  SSD1306_HLine(iX, iY, iWidth);
+  SSD1306_HLine(iX, iY + iHeight - 1, iWidth);
+  SSD1306_VLine(iX, iY + 1, iHeight - 2);
+  SSD1306_VLine(iX + iWidth - 1, iY + 1, iHeight - 2);
+
+  // gap, then fill from the left
+  int iInner = iWidth - 4;
+  int iFill = uiMax ? (int)((unsigned long)iInner * uiValue / uiMax) : 0;
+
+  SSD1306_ClearRect(iX + 1, iY + 1, iWidth - 2, iHeight - 2);
+  SSD1306_FillRect(iX + 2, iY + 2, iFill, iHeight - 4);
 }
 
 #ifdef _SSD1306_DisplaySize128x64
@@ -545,10 +1222,11 @@ void SSD1306_CharXY (unsigned char iX, unsigned char iY, char disp)
   //  _DispBuff[iStartIndex++] = *(const __flash unsigned char *)(_CharMap + ((disp - 31) * 5 + i)); // need to adjust to use full map
   
   // updated when switched to basic AVR code, uses program memory copy function to copy from flash
-  memcpy_P (_DispBuff + iStartIndex, _CharMap + (disp - 31) * 5, 5);
+  // (column 21 only has room for 2 of the 5, don't spill into the next page)
+  memcpy_P (_DispBuff + iStartIndex, _CharMap + (disp - 31) * 5, iX < 21 ? 5 : 2);
   
-  // mark affected page as dirty
-  _DispDirty[iY] = 1;
+  // mark affected columns of the page as dirty
+  SSD1306_Dirty(iY, iX * 6, iX * 6 + 4);
 }
 #endif
 
@@ -574,10 +1252,11 @@ void SSD1306_CharXY (unsigned char iX, unsigned char iY, char disp)
   //  _DispBuff[iStartIndex++] = *(const __flash unsigned char *)(_CharMap + ((disp - 31) * 5 + i)); // need to adjust to use full map
   
   // updated when switched to basic AVR code, uses program memory copy function to copy from flash
-  memcpy_P (_DispBuff + iStartIndex, _CharMap + (disp - 31) * 5, 5);
+  // (column 21 only has room for 2 of the 5, don't spill into the next page)
+  memcpy_P (_DispBuff + iStartIndex, _CharMap + (disp - 31) * 5, iX < 21 ? 5 : 2);
   
-  // mark affected page as dirty
-  _DispDirty[iY] = 1;
+  // mark affected columns of the page as dirty
+  SSD1306_Dirty(iY, iX * 6, iX * 6 + 4);
 }
 #endif
 
@@ -599,4 +1278,129 @@ void SSD1306_StringXY (unsigned char iX, unsigned char iY, char * pStr)
         iY=0;
     }
   }
+}
+
+// StringXY with the string in flash, e.g. SSD1306_StringXY_P(0, 0, PSTR("Hi"))
+void SSD1306_StringXY_P (unsigned char iX, unsigned char iY, PGM_P pStr)
+{
+  char c;
+
+  while ((c = pgm_read_byte(pStr)) != 0)
+  {
+    SSD1306_CharXY(iX, iY, c);
+    
+    pStr = pStr + 1;
+    
+    // same wrapping as SSD1306_StringXY
+    if (++iX > 20)
+    {
+      iX=0;
+      if (++iY > 7)
+        iY=0;
+    }
+  }
+}
+
+// write the digits of uiValue right to left ending at pEnd, at least
+//  ucDigits of them (zero padded) and always at least one
+// returns the first digit
+static char * SSD1306_Digits (char * pEnd, unsigned int uiValue, unsigned char ucDigits)
+{
+  if (ucDigits > 5)
+    ucDigits = 5;
+
+  do
+  {
+    *--pEnd = '0' + uiValue % 10;
+    uiValue /= 10;
+    if (ucDigits)
+      --ucDigits;
+  } while (uiValue || ucDigits);
+
+  return pEnd;
+}
+
+// fixed point number: uiValue holds ucDecimals decimal places (452 with 1
+//  is 45.2), the whole part zero padded to ucDigits
+// formatted on the stack and drawn a character at a time, no printf
+// no wrapping, characters past the end of the row are dropped
+// returns the column after the last character
+unsigned char SSD1306_FixedXY (unsigned char iX, unsigned char iY, unsigned int uiValue, unsigned char ucDecimals, unsigned char ucDigits)
+{
+  char buff [12];
+  char * pStr = buff + sizeof(buff) - 1;
+  unsigned int uiScale = 1;
+
+  // 10^4 is as far as an unsigned int goes
+  if (ucDecimals > 4)
+    ucDecimals = 4;
+  for (unsigned char i = 0; i < ucDecimals; ++i)
+    uiScale *= 10;
+
+  *pStr = 0;
+  if (ucDecimals)
+  {
+    pStr = SSD1306_Digits(pStr, uiValue % uiScale, ucDecimals);
+    *--pStr = '.';
+  }
+  pStr = SSD1306_Digits(pStr, uiValue / uiScale, ucDigits);
+
+  while (*pStr && iX <= 20)
+    SSD1306_CharXY(iX++, iY, *pStr++);
+
+  return iX;
+}
+
+// unsigned number, zero padded to ucDigits (0 or 1 for no padding)
+// returns the column after the last character
+unsigned char SSD1306_DecimalXY (unsigned char iX, unsigned char iY, unsigned int uiValue, unsigned char ucDigits)
+{
+  return SSD1306_FixedXY(iX, iY, uiValue, 0, ucDigits);
+}
+
+// large clock characters, iX in pixels, iPage the top page of the 3 the
+//  glyph covers (page aligned, so each page is a straight copy from flash)
+// '0' to '9' and ':' are drawn, anything else blanks a digit wide cell
+// returns the columns used (0 if the glyph would not fit)
+int SSD1306_BigCharXY (unsigned char iX, unsigned char iPage, char disp)
+{
+  PGM_P pGlyph = 0;
+  int iWidth = _SSD1306_BIG_WIDTH;
+
+  if (disp >= '0' && disp <= '9')
+    pGlyph = (PGM_P)_BigDigitMap + (disp - '0') * 3 * _SSD1306_BIG_WIDTH;
+  else if (disp == ':')
+  {
+    pGlyph = (PGM_P)_BigColonMap;
+    iWidth = _SSD1306_BIG_COLON_WIDTH;
+  }
+
+  // no clipping, the glyph is whole or not drawn
+  if (iX + iWidth > 128 || iPage + 3 > _SSD1306_PAGES)
+    return 0;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    unsigned char * pDest = _DispBuff + (iPage + i) * 128 + iX;
+    if (pGlyph)
+      memcpy_P(pDest, pGlyph + i * iWidth, iWidth);
+    else
+      memset(pDest, 0, iWidth);
+
+    SSD1306_Dirty(iPage + i, iX, iX + iWidth - 1);
+  }
+
+  return iWidth;
+}
+
+// large clock string, no wrapping, stops at the right edge
+void SSD1306_BigStringXY (unsigned char iX, unsigned char iPage, char * pStr)
+{
+  while (*pStr)
+  {
+    int iWidth = SSD1306_BigCharXY(iX, iPage, *pStr++);
+    if (!iWidth)
+      return;
+    iX += iWidth;
+  }
 }
\ No newline at end of file
@@ -0,0 +1,327 @@
+// host test for the bus cost of the drivers
+// runs the I2C library calls, SSD1306 and the VL53L1X API against the
+//  I2CSim models and checks what crossed the bus, transaction by
+//  transaction and byte by byte, so a change that adds bus traffic (or
+//  breaks what the panel or sensor ends up holding) fails here
+//
+// build and run with make -C tests/host, exit status is the failure count
+
+#include <stdio.h>
+#include <string.h>
+#include "I2C.h"
+#include "I2CSim.h"
+#include "SSD1306.h"
+#include "VL53L1X_api.h"
+
+static int _iChecks = 0;
+static int _iFails = 0;
+
+static void Check (const char * pWhat, long lGot, long lWant, int iLine)
+{
+	++_iChecks;
+	if (lGot == lWant)
+		return;
+
+	++_iFails;
+	printf("bus_test.c:%d: %s is %ld, expected %ld\n", iLine, pWhat, lGot, lWant);
+}
+
+#define CHECK(expr, want) Check(#expr, (long)(expr), (long)(want), __LINE__)
+
+// counters for one device since the last call, then cleared
+static I2CSim_Counts _Counts;
+
+static void Take (unsigned char uc7Addr)
+{
+	I2CSim_GetCounts(uc7Addr, &_Counts);
+	I2CSim_ClearCounts();
+}
+
+static int _iCallbacks = 0;
+
+static void Callback (I2C_Transaction * pTrans)
+{
+	(void)pTrans;
+	++_iCallbacks;
+}
+
+// one register block call per transaction, index bytes counted as written
+static void TestBlocking (void)
+{
+	unsigned char ucData[4] = { 0x12, 0x34, 0x56, 0x78 };
+	unsigned char ucIndex[2] = { 0x00, 0x30 };
+	unsigned char ucRead[2] = { 0 };
+
+	I2CSim_Reset();
+	I2C_Init(16000000, I2CBus400);
+
+	// 8-bit index, LM75A: index + 2 data bytes
+	CHECK(I2C_WriteRegs8(I2CSIM_LM75A_ADDR, 0x02, ucData, 2), 0);
+	Take(I2CSIM_LM75A_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 1);
+	CHECK(_Counts.ulBytesWritten, 3);
+	CHECK(_Counts.ulBytesRead, 0);
+
+	CHECK(I2C_WriteRegs8_P(I2CSIM_LM75A_ADDR, 0x02, ucData, 2), 0);
+	Take(I2CSIM_LM75A_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulBytesWritten, 3);
+
+	// index, repeated START, 2 data bytes
+	I2CSim_LM75A_SetTemp(0x1900);
+	CHECK(I2C_ReadRegs8(I2CSIM_LM75A_ADDR, 0x00, ucRead, 2), 0);
+	Take(I2CSIM_LM75A_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 2);
+	CHECK(_Counts.ulBytesWritten, 1);
+	CHECK(_Counts.ulBytesRead, 2);
+	CHECK(ucRead[0], 0x19);
+	CHECK(ucRead[1], 0x00);
+
+	// 16-bit index, VL53L1X: 2 index bytes + data
+	CHECK(I2C_WriteRegs16(I2CSIM_VL53L1X_ADDR, 0x0030, ucData, 1), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 1);
+	CHECK(_Counts.ulBytesWritten, 3);
+	CHECK(I2CSim_VL53L1X_GetReg(0x0030), 0x12);
+
+	CHECK(I2C_WriteRegs16_P(I2CSIM_VL53L1X_ADDR, 0x0030, ucData + 1, 1), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulBytesWritten, 3);
+	CHECK(I2CSim_VL53L1X_GetReg(0x0030), 0x34);
+
+	CHECK(I2C_ReadRegs16(I2CSIM_VL53L1X_ADDR, 0x0030, ucRead, 1), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 2);
+	CHECK(_Counts.ulBytesWritten, 2);
+	CHECK(_Counts.ulBytesRead, 1);
+	CHECK(ucRead[0], 0x34);
+
+	// combined, and with nothing to read a plain write (no repeated START)
+	CHECK(I2C_WriteRead(I2CSIM_VL53L1X_ADDR, ucIndex, 2, ucRead, 1), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 2);
+	CHECK(_Counts.ulBytesWritten, 2);
+	CHECK(_Counts.ulBytesRead, 1);
+
+	CHECK(I2C_WriteRead(I2CSIM_VL53L1X_ADDR, ucIndex, 2, ucRead, 0), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 1);
+	CHECK(_Counts.ulBytesRead, 0);
+
+	// missing device NACKs its address and nothing else goes out
+	//  (an address NACK only shows in the bus totals)
+	I2CSim_SetPresent(I2CSIM_LM75A_ADDR, 0);
+	CHECK(I2C_WriteRegs8(I2CSIM_LM75A_ADDR, 0x02, ucData, 2), -2);
+	Take(0);
+	CHECK(_Counts.ulNacks, 1);
+	CHECK(_Counts.ulBytesWritten, 0);
+}
+
+// queued transaction runs header, writes, repeated START, reads, callback
+static void TestQueue (void)
+{
+	unsigned char ucRead[2] = { 0 };
+	I2C_Transaction trans;
+
+	I2CSim_Reset();
+	I2C_Init(16000000, I2CBus400);
+	I2CSim_LM75A_SetTemp(0x1A80);
+
+	memset(&trans, 0, sizeof(trans));
+	trans.uc7Addr = I2CSIM_LM75A_ADDR;
+	trans.ucHeader[0] = 0x00;
+	trans.ucHeaderCount = 1;
+	trans.pRead = ucRead;
+	trans.uiReadCount = 2;
+	trans.pCallback = Callback;
+
+	_iCallbacks = 0;
+	CHECK(I2C_Submit(&trans), 0);
+	CHECK(I2C_Wait(&trans), 0);
+	CHECK(_iCallbacks, 1);
+	CHECK(I2C_Busy(), 0);
+	Take(I2CSIM_LM75A_ADDR);
+	CHECK(_Counts.ulTransactions, 1);
+	CHECK(_Counts.ulStarts, 2);
+	CHECK(_Counts.ulBytesWritten, 1);
+	CHECK(_Counts.ulBytesRead, 2);
+	CHECK(ucRead[0], 0x1A);
+	CHECK(ucRead[1], 0x80);
+}
+
+// init stream, full first frame, then only what changed
+static void TestSSD1306 (void)
+{
+	I2CSim_SSD1306_State state;
+	unsigned char ucPanel[8 * 128];
+
+	I2CSim_Reset();
+	I2C_Init(16000000, I2CBus400);
+
+	// the whole init table in one transaction, then the Clear renders a
+	//  full frame (panel RAM unknown after init): window commands and the
+	//  512 bytes of a 128x32 panel
+	SSD1306_DispInit();
+	Take(I2CSIM_SSD1306_ADDR);
+	I2CSim_SSD1306_GetState(&state);
+	CHECK(_Counts.ulTransactions, 3);
+	CHECK(state.ulDataBytes, 512);
+
+	// nothing drawn, nothing sent
+	SSD1306_Render();
+	Take(I2CSIM_SSD1306_ADDR);
+	CHECK(_Counts.ulTransactions, 0);
+
+	// one character, a window and the 5 columns of the glyph (the gap
+	//  column was blank already)
+	SSD1306_CharXY(2, 1, 'A');
+	SSD1306_Render();
+	Take(I2CSIM_SSD1306_ADDR);
+	I2CSim_SSD1306_GetState(&state);
+	CHECK(state.ulDataBytes - 512, 5);
+	CHECK(_Counts.ulTransactions, 2);
+
+	// async render leaves the panel as a blocking one would
+	memcpy(ucPanel, I2CSim_SSD1306_GDDRAM(), sizeof(ucPanel));
+	SSD1306_Line(0, 0, 127, 31);
+	SSD1306_Render();
+	SSD1306_ClearRect(0, 0, 128, 32);
+	SSD1306_CharXY(2, 1, 'A');
+	SSD1306_RenderAsync();
+	CHECK(SSD1306_RenderBusy(), 0);
+	CHECK(memcmp(ucPanel, I2CSim_SSD1306_GDDRAM(), sizeof(ucPanel)), 0);
+
+	// last character cell is cut at column 127, nothing wraps onto the
+	//  start of the next page
+	I2CSim_ClearCounts();
+	I2CSim_SSD1306_GetState(&state);
+	{
+		unsigned long ulBefore = state.ulDataBytes;
+
+		SSD1306_CharXY(21, 0, 'A');
+		SSD1306_Render();
+		I2CSim_SSD1306_GetState(&state);
+		CHECK(state.ulDataBytes - ulBefore, 2);
+		CHECK(I2CSim_SSD1306_GDDRAM()[128] | I2CSim_SSD1306_GDDRAM()[129] | I2CSim_SSD1306_GDDRAM()[130], 0);
+		CHECK(state.ucColEnd, 127);
+	}
+
+	// RLE and stored bitmaps land the same way, a run of two columns and
+	//  two columns as they are, one page high
+	{
+		static const unsigned char ucRun[] PROGMEM = { 0x02, 0x01, 0x81, 0xAA };
+		static const unsigned char ucStored[] PROGMEM = { 0x02, 0x81, 0x12, 0x34 };
+
+		SSD1306_BlitRLE(40, 2, (PGM_P)ucRun);
+		SSD1306_BlitRLE(42, 2, (PGM_P)ucStored);
+		SSD1306_Render();
+		CHECK(I2CSim_SSD1306_GDDRAM()[2 * 128 + 40], 0xAA);
+		CHECK(I2CSim_SSD1306_GDDRAM()[2 * 128 + 41], 0xAA);
+		CHECK(I2CSim_SSD1306_GDDRAM()[2 * 128 + 42], 0x12);
+		CHECK(I2CSim_SSD1306_GDDRAM()[2 * 128 + 43], 0x34);
+		CHECK(I2CSim_SSD1306_GDDRAM()[2 * 128 + 44], 0x00);
+	}
+
+	// while the panel scrolls renders hold, so no data is written
+	I2CSim_ClearCounts();
+	I2CSim_SSD1306_GetState(&state);
+	SSD1306_ScrollH(0, 0, 3, SSD1306_SCROLL_5);
+	SSD1306_Line(0, 0, 127, 31);
+	SSD1306_Render();
+	SSD1306_Render();
+	{
+		unsigned long ulBefore = state.ulDataBytes;
+
+		I2CSim_SSD1306_GetState(&state);
+		CHECK(state.ulDataBytes - ulBefore, 0);
+		CHECK(state.ulScrollWrites, 0);
+		CHECK(state.bScrolling, 1);
+	}
+
+	// stopping resends the scrolled pages, all four of them
+	{
+		unsigned long ulBefore = state.ulDataBytes;
+
+		SSD1306_ScrollStop();
+		SSD1306_Render();
+		I2CSim_SSD1306_GetState(&state);
+		CHECK(state.bScrolling, 0);
+		CHECK(state.ulDataBytes - ulBefore, 512);
+	}
+}
+
+// init burst, one transaction per poll and two per sample
+static void TestVL53L1X (void)
+{
+	static const unsigned int uiTrace[] = { 300, 800, 450 };
+	VL53L1X_ResultEx_t result;
+	uint16_t uiValue;
+	uint8_t ucReady;
+
+	I2CSim_Reset();
+	I2C_Init(16000000, I2CBus400);
+	I2CSim_VL53L1X_SetReadyDelay(0);
+	I2CSim_VL53L1X_SetTrace(uiTrace, 3);
+
+	// config burst, start, one ready poll, clear, stop, two VHV writes
+	//  (the polarity behind the poll comes from the platform shadow)
+	CHECK(VL53L1X_SensorInit(0), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 7);
+	CHECK(_Counts.ulBytesWritten, 2 + 91 + 3 + 2 + 3 + 3 + 3 + 3);
+	CHECK(_Counts.ulBytesRead, 1);
+
+	// configuration read back from the shadow, not the bus
+	CHECK(VL53L1X_SetTimingBudgetInMs(0, 100), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulBytesRead, 0);
+	CHECK(VL53L1X_GetTimingBudgetInMs(0, &uiValue), 0);
+	CHECK(uiValue, 100);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 0);
+
+	// ready on the third poll
+	I2CSim_VL53L1X_SetReadyDelay(2);
+	CHECK(VL53L1X_StartRanging(0), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+
+	// status byte only, always from the device
+	ucReady = 0;
+	while (!ucReady)
+		CHECK(VL53L1X_CheckForDataReady(0, &ucReady), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 3);
+	CHECK(_Counts.ulBytesWritten, 3 * 2);
+	CHECK(_Counts.ulBytesRead, 3);
+
+	// result block in one read, then the interrupt clear
+	CHECK(VL53L1X_GetResultEx(0, &result), 0);
+	CHECK(VL53L1X_ClearInterrupt(0), 0);
+	Take(I2CSIM_VL53L1X_ADDR);
+	CHECK(_Counts.ulTransactions, 2);
+	CHECK(_Counts.ulBytesWritten, 2 + 3);
+	CHECK(_Counts.ulBytesRead, 17);
+	CHECK(result.Distance, 800);
+
+	// same answer as the single register getter
+	CHECK(VL53L1X_GetDistance(0, &uiValue), 0);
+	CHECK(uiValue, result.Distance);
+}
+
+int main (void)
+{
+	TestBlocking();
+	TestQueue();
+	TestSSD1306();
+	TestVL53L1X();
+
+	printf("%d checks, %d failed\n", _iChecks, _iFails);
+	return _iFails;
+}
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+# RLE bitmap encoder for SSD1306_BlitRLE
+# converts a PBM (P1/P4) or PNG into a PROGMEM array for the SSD1306 library
+#
+# usage: rle_encode.py [--invert] [--name NAME] image.pbm|image.png [...]
+#  prints one C array per image on stdout, named after the file unless
+#  --name is given (only with a single image)
+#
+# pixels that are on: PBM 1 bits (black), PNG pixels darker than half
+#  brightness (or with alpha under half), --invert flips that
+# image height is padded to a whole number of 8 row pages
+#
+# asset layout:
+#  byte 0     width in columns (1 to 128)
+#  byte 1     height in pages, 0x80 set if the bitmap is stored
+#  then the page bytes (bit 0 is the top row of the page), page 0
+#  columns 0..width-1, then page 1, ..., coded as packets:
+#   0x80 | (n - 1), b         run, byte b n times (n 1 to 128)
+#   n - 1, b1 .. bn           literal, the next n bytes as they are
+#  or, when stored, as they are with no packets
+# small busy bitmaps (icons) have few runs, so RLE only wins if it is
+#  smaller than storing, otherwise the asset is stored
+
+import argparse
+import os
+import re
+import struct
+import sys
+import zlib
+
+
+def read_pbm(data):
+    # header tokens, skipping comments, then the raster
+    pos = 0
+    tokens = []
+    while len(tokens) < 3:
+        match = re.compile(rb'\s*(#[^\n]*\n\s*)*([^\s#]+)').match(data, pos)
+        if not match:
+            raise ValueError('bad PBM header')
+        tokens.append(match.group(2))
+        pos = match.end()
+    magic, width, height = tokens[0], int(tokens[1]), int(tokens[2])
+
+    if magic == b'P1':
+        bits = [c == ord('1') for c in data[pos:] if c in b'01']
+        return width, height, [bits[y * width:(y + 1) * width] for y in range(height)]
+
+    if magic == b'P4':
+        raster = data[pos + 1:]
+        stride = (width + 7) // 8
+        return width, height, [[bool(raster[y * stride + x // 8] & (0x80 >> (x % 8)))
+                                for x in range(width)] for y in range(height)]
+
+    raise ValueError('only P1 and P4 PBM are supported')
+
+
+def read_png(data):
+    # enough of PNG for bitmaps: 8-bit grey, grey+alpha, RGB, RGBA or
+    #  palette, not interlaced
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ValueError('not a PNG')
+
+    pos = 8
+    idat = b''
+    palette = None
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, colour, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif kind == b'PLTE':
+            palette = [chunk[i:i + 3] for i in range(0, len(chunk), 3)]
+        elif kind == b'IDAT':
+            idat += chunk
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(colour)
+    if depth != 8 or interlace or channels is None:
+        raise ValueError('PNG must be 8-bit and not interlaced')
+
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    prev = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        line = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            a = line[i - channels] if i >= channels else 0
+            b = prev[i]
+            c = prev[i - channels] if i >= channels else 0
+            if kind == 1:
+                line[i] = (line[i] + a) & 0xFF
+            elif kind == 2:
+                line[i] = (line[i] + b) & 0xFF
+            elif kind == 3:
+                line[i] = (line[i] + (a + b) // 2) & 0xFF
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[i] = (line[i] + pred) & 0xFF
+        rows.append(line)
+        prev = line
+
+    pixels = []
+    for line in rows:
+        row = []
+        for x in range(width):
+            px = line[x * channels:(x + 1) * channels]
+            if colour == 3:
+                px = palette[px[0]]
+            alpha = px[-1] if colour in (4, 6) else 255
+            grey = sum(px[:3]) / 3 if colour in (2, 3, 6) else px[0]
+            row.append(alpha >= 128 and grey < 128)
+        pixels.append(row)
+    return width, height, pixels
+
+
+def to_pages(width, height, pixels):
+    pages = (height + 7) // 8
+    out = []
+    for page in range(pages):
+        for x in range(width):
+            byte = 0
+            for bit in range(8):
+                y = page * 8 + bit
+                if y < height and pixels[y][x]:
+                    byte |= 1 << bit
+            out.append(byte)
+    return pages, out
+
+
+def rle(data):
+    out = []
+    literal = []
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and data[i + run] == data[i] and run < 128:
+            run += 1
+
+        # a run of 3 or more is cheaper as a run packet, shorter ones ride
+        #  along in the literal
+        if run >= 3:
+            if literal:
+                out += [len(literal) - 1] + literal
+                literal = []
+            out += [0x80 | (run - 1), data[i]]
+            i += run
+            continue
+
+        literal.append(data[i])
+        i += 1
+        if len(literal) == 128:
+            out += [len(literal) - 1] + literal
+            literal = []
+
+    if literal:
+        out += [len(literal) - 1] + literal
+    return out
+
+
+def encode(path, name, invert):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    if data[:2] in (b'P1', b'P4'):
+        width, height, pixels = read_pbm(data)
+    else:
+        width, height, pixels = read_png(data)
+
+    if invert:
+        pixels = [[not p for p in row] for row in pixels]
+    if not 1 <= width <= 128:
+        raise ValueError('%s: width must be 1 to 128' % path)
+
+    pages, raw = to_pages(width, height, pixels)
+    coded = rle(raw)
+    if len(coded) < len(raw):
+        packed = [width, pages] + coded
+        kind = 'RLE'
+    else:
+        packed = [width, 0x80 | pages] + raw
+        kind = 'stored'
+
+    lines = ['// %s, %d x %d, %s, %d bytes (%d raw)' % (os.path.basename(path), width, pages * 8,
+                                                       kind, len(packed), len(raw)),
+             'static const unsigned char %s [%d] PROGMEM =' % (name, len(packed)),
+             '{']
+    for i in range(0, len(packed), 16):
+        chunk = ', '.join('0x%02X' % b for b in packed[i:i + 16])
+        lines.append('  ' + chunk + (',' if i + 16 < len(packed) else ''))
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='RLE encode bitmaps for SSD1306_BlitRLE')
+    parser.add_argument('--invert', action='store_true', help='swap on and off pixels')
+    parser.add_argument('--name', help='array name (single image only)')
+    parser.add_argument('images', nargs='+')
+    args = parser.parse_args()
+
+    if args.name and len(args.images) > 1:
+        parser.error('--name needs a single image')
+
+    out = []
+    for path in args.images:
+        name = args.name or re.sub(r'\W', '_', os.path.splitext(os.path.basename(path))[0])
+        out.append(encode(path, name, args.invert))
+    print('\n\n'.join(out))
+
+
+if __name__ == '__main__':
+    sys.exit(main())